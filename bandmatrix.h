@@ -0,0 +1,72 @@
+/* symmetric positive definite band matrix with an in-place cholesky factorization */
+class BandMatrix
+{
+private:
+	int n;                  // the amount of rows and columns
+	int bandwidth;          // the amount of non-zero diagonals below the main diagonal
+	std::vector<double> a;  // the lower band, row by row, the main diagonal is the last entry of every row
+
+	// returns a reference to an element of the lower band, i >= j and i - j <= bandwidth
+	double& At(int i, int j) { return a[i * (bandwidth + 1) + bandwidth - (i - j)]; }
+
+public:
+	// constructor
+	BandMatrix() : n(0), bandwidth(0) {}
+
+	// resizes the matrix and sets all the elements to zero
+	void Resize(int size, int band)
+	{
+		n = size;
+		bandwidth = band;
+		a.assign((size_t)n * (bandwidth + 1), 0.0);
+	}
+
+	// adds a value to an element of the lower band, the upper band follows from the symmetry
+	void Add(int i, int j, double value)
+	{
+		if (i < j) std::swap(i, j);
+		At(i, j) += value;
+	}
+
+	// replaces the matrix by its cholesky factor, returns false if the matrix isn't positive definite
+	bool Factor()
+	{
+		for (int i = 0; i < n; i++)
+			for (int j = std::max(0, i - bandwidth); j <= i; j++)
+			{
+				double sum = At(i, j);
+				for (int k = std::max(0, i - bandwidth); k < j; k++)
+					sum -= At(i, k) * At(j, k);
+
+				if (i == j)
+				{
+					if (sum <= 0.0)
+						return false;
+					At(i, i) = sqrt(sum);
+				}
+				else
+					At(i, j) = sum / At(j, j);
+			}
+		return true;
+	}
+
+	// solves the factored system in place by forward and backward substitution
+	void Solve(std::vector<double> &b)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			double sum = b[i];
+			for (int k = std::max(0, i - bandwidth); k < i; k++)
+				sum -= At(i, k) * b[k];
+			b[i] = sum / At(i, i);
+		}
+
+		for (int i = n - 1; i >= 0; i--)
+		{
+			double sum = b[i];
+			for (int k = i + 1; k <= std::min(n - 1, i + bandwidth); k++)
+				sum -= At(k, i) * b[k];
+			b[i] = sum / At(i, i);
+		}
+	}
+};
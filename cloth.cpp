@@ -1,9 +1,158 @@
 #include "precomp.h" // only include this header in source files
 
+// header of the binary cloth state files, followed by the (compressed) particle and constraint data
+struct StateHeader
+{
+	char magic[4];                         // always "CLTH"
+	unsigned int version;                  // the version of the file format
+	unsigned int compressed;               // is the data compressed with zlib or not
+	unsigned int width, height;            // the resolution of the cloth
+	unsigned int constraintCount;          // the amount of remaining constraints
+	unsigned int rawSize, storedSize;      // the size of the data before and after compression
+	unsigned long long seed, step;         // the seed and the amount of updates, so a restored cloth tears the same
+};
+
+// appends raw bytes to a buffer
+static void AppendBytes(std::vector<unsigned char> &buffer, const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+// appends the components of a vector as raw floats, the state is saved in float whatever the precision of the cloth
+template<typename V>
+static void AppendVector(std::vector<unsigned char> &buffer, const V &v)
+{
+	float f[3] = { (float)v.f[0], (float)v.f[1], (float)v.f[2] };
+	AppendBytes(buffer, f, sizeof(f));
+}
+
+// copies the positions of particles into a buffer of 3 values per particle, in the precision of the buffer
+template<typename V, typename U>
+static void CopyParticlePositions(std::vector<BasicParticle<V> > &particles, U *out)
+{
+	for (size_t i = 0; i < particles.size(); i++)
+	{
+		V &pos = particles[i].GetPos();
+		out[3 * i] = (U)pos.f[0];
+		out[3 * i + 1] = (U)pos.f[1];
+		out[3 * i + 2] = (U)pos.f[2];
+	}
+}
+
+// calculates how far the tethered particles are pulled back towards their anchor, the particles in range get a scale of zero
+template<typename T>
+static void TetherScales(const T *x, const T *y, const T *z, const T *dist, T *scale, int begin, int end)
+{
+	for (int i = begin; i < end; i++)
+	{
+		T l = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+		scale[i] = (l > dist[i]) ? dist[i] / l - 1 : 0;
+	}
+}
+
+// the same in float, 4 tethers at the time if sse2 is available
+static void TetherScales(const float *x, const float *y, const float *z, const float *dist, float *scale, int begin, int end)
+{
+	int i = begin;
+#ifdef USE_SSE2
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 dx = _mm_loadu_ps(x + i), dy = _mm_loadu_ps(y + i), dz = _mm_loadu_ps(z + i), range = _mm_loadu_ps(dist + i);
+		__m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 pull = _mm_sub_ps(_mm_div_ps(range, l), _mm_set1_ps(1.0f));
+		_mm_storeu_ps(scale + i, _mm_and_ps(_mm_cmpgt_ps(l, range), pull));
+	}
+#endif
+	TetherScales<float>(x, y, z, dist, scale, i, end);
+}
+
 /* Private methods */
 
+// puts all the particles in a tile to sleep
+template<typename V>
+void BasicCloth<V>::SleepTile(int tx, int ty)
+{
+	Tile &tile = tiles[tx + ty * tilesWidth];
+	if (tile.asleep)
+		return;
+	tile.asleep = true;
+	awakeTiles--;
+
+	for (int x = tx * TILESIZE; x < particlesWidth && x < (tx + 1) * TILESIZE; x++)
+		for (int y = ty * TILESIZE; y < particlesHeight && y < (ty + 1) * TILESIZE; y++)
+			GetParticle(x, y)->Sleep();
+}
+
+// wakes up all the particles in a tile
+template<typename V>
+void BasicCloth<V>::WakeTile(int tx, int ty)
+{
+	Tile &tile = tiles[tx + ty * tilesWidth];
+	if (!tile.asleep)
+		return;
+	tile.asleep = false;
+	tile.quietSteps = 0;
+	awakeTiles++;
+
+	for (int x = tx * TILESIZE; x < particlesWidth && x < (tx + 1) * TILESIZE; x++)
+		for (int y = ty * TILESIZE; y < particlesHeight && y < (ty + 1) * TILESIZE; y++)
+			GetParticle(x, y)->WakeUp();
+}
+
+// wakes up the tile a particle belongs to
+template<typename V>
+void BasicCloth<V>::WakeParticle(Particle *p)
+{
+	int i = (int)(p - &particles[0]);
+	WakeTile((i % particlesWidth) / TILESIZE, (i / particlesWidth) / TILESIZE);
+}
+
+// updates the energy of the tiles and puts the resting tiles to sleep
+template<typename V>
+void BasicCloth<V>::UpdateSleeping()
+{
+	// count the quiet timesteps of the awake tiles, based on the mean energy per particle
+	for (int tx = 0; tx < tilesWidth; tx++)
+		for (int ty = 0; ty < tilesHeight; ty++)
+		{
+			Tile &tile = tiles[tx + ty * tilesWidth];
+			int count = (std::min((tx + 1) * TILESIZE, particlesWidth) - tx * TILESIZE) * (std::min((ty + 1) * TILESIZE, particlesHeight) - ty * TILESIZE);
+			tile.energy /= count;
+
+			if (!tile.asleep)
+				tile.quietSteps = (tile.energy < SLEEPENERGY) ? tile.quietSteps + 1 : 0;
+		}
+
+	// wake up the sleeping tiles next to an energetic tile
+	// put tiles to sleep once they and their awake neighbors have been quiet long enough
+	for (int tx = 0; tx < tilesWidth; tx++)
+		for (int ty = 0; ty < tilesHeight; ty++)
+		{
+			bool wake = false, sleep = true;
+			for (int nx = std::max(tx - 1, 0); nx <= std::min(tx + 1, tilesWidth - 1); nx++)
+				for (int ny = std::max(ty - 1, 0); ny <= std::min(ty + 1, tilesHeight - 1); ny++)
+				{
+					Tile &neighbor = tiles[nx + ny * tilesWidth];
+					if (neighbor.energy > WAKEENERGY)
+						wake = true;
+					if (!neighbor.asleep && neighbor.quietSteps < SLEEPSTEPS)
+						sleep = false;
+				}
+
+			if (tiles[tx + ty * tilesWidth].asleep)
+			{
+				if (wake)
+					WakeTile(tx, ty);
+			}
+			else if (sleep)
+				SleepTile(tx, ty);
+		}
+}
+
 // set the pattern of the cloth
-Vec3 Cloth::ClothPattern(int x, int y)
+template<typename V>
+Vec3 BasicCloth<V>::ClothPattern(int x, int y)
 {
 	switch (pattern)
 	{
@@ -26,90 +175,793 @@ Vec3 Cloth::ClothPattern(int x, int y)
 			return color2;
 		break;
 	case Pattern::Random:
-		if (rand() % 2 == 0)
+		if (patternRandom.NextBool())
 			return color1;
 		else
 			return color2;
 		break;
+	case Pattern::Image:
+		// take the pixel the quad falls on, without an image the cloth has a single color
+		if (patternImage.empty())
+			return color1;
+		else
+		{
+			int px = std::min(x * imageWidth / (particlesWidth - 1), imageWidth - 1);
+			int py = std::min(y * imageHeight / (particlesHeight - 1), imageHeight - 1);
+			const unsigned char *pixel = &patternImage[4 * (px + py * imageWidth)];
+			return Vec3(pixel[0], pixel[1], pixel[2]) / 255.0f;
+		}
+		break;
 	}
+	return color1;
+}
+
+// bakes the pattern into the colors of the quads, the random pattern always starts from the same point
+template<typename V>
+void BasicCloth<V>::BakePattern()
+{
+	patternRandom.Seed(seed ^ 0x5bd1e995ULL);
+	cellColors.resize((particlesWidth - 1) * (particlesHeight - 1));
+	for (int x = 0; x < particlesWidth - 1; x++)
+		for (int y = 0; y < particlesHeight - 1; y++)
+			cellColors[x + y * (particlesWidth - 1)] = ClothPattern(x, y);
+	colorsDirty = true;
 }
 
 // calculates the normal of a triangle, defined by 3 particles
-Vec3 Cloth::CalcTriangleNormal(Particle *p1, Particle *p2, Particle *p3)
+template<typename V>
+V BasicCloth<V>::CalcTriangleNormal(Particle *p1, Particle *p2, Particle *p3)
 {
 	// get the vertices and calculate the edges 
-	Vec3 v1 = p1->GetPos(), v2 = p2->GetPos(), v3 = p3->GetPos();
-	Vec3 e1 = v2 - v1, e2 = v3 - v1;
+	V v1 = p1->GetPos(), v2 = p2->GetPos(), v3 = p3->GetPos();
+	V e1 = v2 - v1, e2 = v3 - v1;
 
 	// return the normal
 	return e1.Cross(e2);
 }
 
-// color and draw a triangle
-void Cloth::DrawTriangle(Particle *p1, Particle *p2, Particle *p3, const Vec3 color)
+// calculates the normals of the two triangles of a quad
+template<typename V>
+void BasicCloth<V>::UpdateQuadNormals(int x, int y)
 {
-	// set the color
-	glColor3fv((GLfloat*)&color);
-
-	// set the vertices and normals for the vertices 
-	glNormal3fv((GLfloat *) &(p1->GetNormal().Normalized()));
-	glVertex3fv((GLfloat *) &(p1->GetPos()));
-
-	glNormal3fv((GLfloat *) &(p2->GetNormal().Normalized()));
-	glVertex3fv((GLfloat *) &(p2->GetPos()));
+	int quad = 2 * (x + y * (particlesWidth - 1));
+	faceNormals[quad] = CalcTriangleNormal(GetParticle(x + 1, y), GetParticle(x, y), GetParticle(x, y + 1));
+	faceNormals[quad + 1] = CalcTriangleNormal(GetParticle(x + 1, y + 1), GetParticle(x + 1, y), GetParticle(x, y + 1));
+}
 
-	glNormal3fv((GLfloat *) &(p3->GetNormal().Normalized()));
-	glVertex3fv((GLfloat *) &(p3->GetPos()));
+// adds a triangle with the smooth normals of its particles to the draw arrays, and its colors and texture coordinates
+// if they are rebuilt
+template<typename V>
+void BasicCloth<V>::AddTriangle(Particle *p1, Particle *p2, Particle *p3, const Vec3 &color)
+{
+	Particle *corners[3] = { p1, p2, p3 };
+	for (int i = 0; i < 3; i++)
+	{
+		V normal = corners[i]->GetNormal().Normalized();
+		V &pos = corners[i]->GetPos();
+		for (int c = 0; c < 3; c++)
+		{
+			drawVertices.push_back((float)pos.f[c]);
+			drawNormals.push_back((float)normal.f[c]);
+		}
+		if (colorsDirty)
+		{
+			float *uv = &gridUVs[2 * (corners[i] - &particles[0])];
+			drawColors.insert(drawColors.end(), color.f, color.f + 3);
+			drawUVs.insert(drawUVs.end(), uv, uv + 2);
+		}
+	}
 }
 
-// method to simulate forces on the triangle
-void Cloth::AddForcesToTriangle(Particle *p1, Particle *p2, Particle *p3, const Vec3 direction)
+// method to simulate the aerodynamic forces on the triangle, based on the velocity of the triangle relative to the wind
+template<typename V>
+void BasicCloth<V>::AddForcesToTriangle(Particle *p1, Particle *p2, Particle *p3, const V normal, const V wind)
 {
-	// calculate the normal and normalize it
-	Vec3 normal = CalcTriangleNormal(p1, p2, p3);
-	Vec3 d = normal.Normalized();
+	// calculate the velocity of the air relative to the triangle
+	V velocity = (p1->GetVelocity() + p2->GetVelocity() + p3->GetVelocity()) / 3.0f;
+	V relWind = V(wind) - velocity;
+	T speed = relWind.Length();
+	if (speed == 0.0f)
+		return;
+
+	// the length of the normal is proportional to the area of the triangle
+	T area = V(normal).Length();
+	if (area == 0.0f)
+		return;
+
+	// orient the normal so that it faces away from the incoming air
+	V n = normal / area, w = relWind / speed;
+	T cosTheta = n.Dot(w);
+	if (cosTheta < 0.0f)
+	{
+		n = -n;
+		cosTheta = -cosTheta;
+	}
+
+	// drag acts along the relative wind, lift perpendicular to it in the plane of the normal
+	// both scale with the area of the triangle as seen from the wind direction
+	V dragForce = relWind * (drag * area * cosTheta);
+	V liftForce = (n - w * cosTheta) * (lift * area * cosTheta * speed);
 
-	// calculate the force and add the force to the vertices
-	Vec3 force = normal * (d.Dot(direction));
+	// a strong enough force wakes up sleeping particles
+	V force = dragForce + liftForce;
+	if (force.Length() > WAKEFORCE)
+	{
+		if (p1->IsSleeping()) WakeParticle(p1);
+		if (p2->IsSleeping()) WakeParticle(p2);
+		if (p3->IsSleeping()) WakeParticle(p3);
+	}
+
+	// add the force to the vertices
 	p1->AddForce(force);
 	p2->AddForce(force);
 	p3->AddForce(force);
 }
 
+// builds the coarse grids, each level has half the resolution of the previous one
+template<typename V>
+void BasicCloth<V>::BuildHierarchy()
+{
+	levels.clear();
+	for (int stride = 2; ; stride *= 2)
+	{
+		// take every stride-th particle, including the last row and column
+		Level level;
+		level.stride = stride;
+		for (int x = 0; x < particlesWidth; x += stride) level.xs.push_back(x);
+		for (int y = 0; y < particlesHeight; y += stride) level.ys.push_back(y);
+		if (level.xs.back() != particlesWidth - 1) level.xs.push_back(particlesWidth - 1);
+		if (level.ys.back() != particlesHeight - 1) level.ys.push_back(particlesHeight - 1);
+
+		// stop once the grid becomes too coarse to be useful
+		if (level.xs.size() < 4 || level.ys.size() < 4)
+			break;
+
+		// connect the grid points to their neighbors, the same way the particles of the cloth are connected
+		int w = (int)level.xs.size(), h = (int)level.ys.size();
+		for (int i = 0; i < w; i++)
+			for (int j = 0; j < h; j++)
+			{
+				Particle *p = GetParticle(level.xs[i], level.ys[j]);
+				if (i < w - 1) level.constraints.push_back(Constraint(p, GetParticle(level.xs[i + 1], level.ys[j])));
+				if (j < h - 1) level.constraints.push_back(Constraint(p, GetParticle(level.xs[i], level.ys[j + 1])));
+				if (i < w - 1 && j < h - 1) level.constraints.push_back(Constraint(p, GetParticle(level.xs[i + 1], level.ys[j + 1])));
+				if (i < w - 1 && j < h - 1) level.constraints.push_back(Constraint(GetParticle(level.xs[i + 1], level.ys[j]), GetParticle(level.xs[i], level.ys[j + 1])));
+			}
+		level.correction.resize(w * h);
+		levels.push_back(level);
+	}
+}
+
+// solves the coarse grids from coarse to fine, and prolongs their corrections to the finer grid
+template<typename V>
+void BasicCloth<V>::SolveHierarchy()
+{
+	// remember the positions of the grid points of every level before any of them moves,
+	// so every level passes on its own correction together with the corrections it received from the coarser levels
+	for (size_t l = 0; l < levels.size(); l++)
+	{
+		Level &level = levels[l];
+		int w = (int)level.xs.size(), h = (int)level.ys.size();
+		for (int i = 0; i < w; i++)
+			for (int j = 0; j < h; j++)
+				level.correction[i + j * w] = GetParticle(level.xs[i], level.ys[j])->GetPos();
+	}
+
+	for (int l = (int)levels.size() - 1; l >= 0; l--)
+	{
+		Level &level = levels[l];
+		int w = (int)level.xs.size(), h = (int)level.ys.size();
+
+		// satisfy the coarse constraints, they only resist stretching and are ignored near tears
+		typename std::vector<Constraint>::iterator constraint;
+		for (int i = 0; i < multigridIter; i++)
+			for (constraint = level.constraints.begin(); constraint != level.constraints.end(); constraint++)
+			{
+				Particle *p1 = (*constraint).p1, *p2 = (*constraint).p2;
+				if (p1->IsBroken() || p2->IsBroken() || (p1->IsSleeping() && p2->IsSleeping()))
+					continue;
+				(*constraint).SatisfyStretch();
+			}
+
+		// calculate the total displacement of the grid points, including the displacement of the coarser levels
+		for (int i = 0; i < w; i++)
+			for (int j = 0; j < h; j++)
+				level.correction[i + j * w] = GetParticle(level.xs[i], level.ys[j])->GetPos() - level.correction[i + j * w];
+
+		// interpolate the displacement bilinearly to the particles of the finer grid that aren't part of this grid
+		int fw = (l > 0) ? (int)levels[l - 1].xs.size() : particlesWidth;
+		int fh = (l > 0) ? (int)levels[l - 1].ys.size() : particlesHeight;
+		for (int a = 0; a < fw; a++)
+			for (int b = 0; b < fh; b++)
+			{
+				int x = (l > 0) ? levels[l - 1].xs[a] : a, y = (l > 0) ? levels[l - 1].ys[b] : b;
+				int i = std::min(x / level.stride, w - 2), j = std::min(y / level.stride, h - 2);
+				if (x == level.xs[i] || x == level.xs[i + 1])
+					if (y == level.ys[j] || y == level.ys[j + 1])
+						continue;
+
+				float tx = (x - level.xs[i]) / (float)(level.xs[i + 1] - level.xs[i]);
+				float ty = (y - level.ys[j]) / (float)(level.ys[j + 1] - level.ys[j]);
+				V top = level.correction[i + j * w] * (1 - tx) + level.correction[i + 1 + j * w] * tx;
+				V bottom = level.correction[i + (j + 1) * w] * (1 - tx) + level.correction[i + 1 + (j + 1) * w] * tx;
+				GetParticle(x, y)->OffsetPos(top * (1 - ty) + bottom * ty);
+			}
+	}
+}
+
+// iterates over the constraints and satisfies them, until the violation is within the tolerance
+template<typename V>
+template<bool Tearable, bool Checked>
+void BasicCloth<V>::SolveConstraintsKernel()
+{
+	// iterate over the constraints several times and satisfy them
+	// constraints between two sleeping particles are skipped
+	// if the constraint stretched too far, break it
+	typename std::vector<Constraint>::iterator constraint;
+	float omega = 1.0f;
+	for (lastIter = 0; lastIter < constIter; lastIter++)
+	{
+		T error, maxError = 0, sumError = 0;
+		int count = 0;
+
+		for (constraint = constraints.begin(); constraint != constraints.end(); constraint++)
+		{
+			if (Checked && (*constraint).p1->IsSleeping() && (*constraint).p2->IsSleeping())
+				continue;
+
+			if ((*constraint).template SatisfyConstraint<Tearable, Checked>(stretch, error, tearKey))
+			{
+				// save a copy of the broken constraint, the tethers need to follow the tear
+				backupConstraints.push_back(*constraint);
+				constraints.erase(constraint--);
+				torn = tethersDirty = true;
+				continue;
+			}
+
+			// keep track of the residual of this iteration
+			maxError = std::max(maxError, error);
+			sumError += error * error;
+			count++;
+		}
+
+		maxResidual = (float)maxError;
+		rmsResidual = count ? (float)std::sqrt(sumError / count) : 0.0f;
+
+		// extrapolate the positions towards the solution
+		if (chebyshev)
+			AccelerateIteration(lastIter, omega);
+
+		// stop once the constraints are satisfied well enough, this iteration is done
+		if (Converged(lastIter + 1))
+		{
+			lastIter++;
+			break;
+		}
+	}
+}
+
+// picks the constraint kernel for the features the cloth uses during this update
+template<typename V>
+void BasicCloth<V>::SolveConstraints()
+{
+	// the particles only need to be checked if some of them are pinned or sleeping
+	bool checked = pinnedCount > 0 || awakeTiles < (int)tiles.size();
+	if (tearable)
+		checked ? SolveConstraintsKernel<true, true>() : SolveConstraintsKernel<true, false>();
+	else
+		checked ? SolveConstraintsKernel<false, true>() : SolveConstraintsKernel<false, false>();
+}
+
+// counts the pinned particles and checks for broken particles, after the particles were pinned, reset or loaded
+template<typename V>
+void BasicCloth<V>::CountFeatures()
+{
+	pinnedCount = 0;
+	torn = false;
+	typename std::vector<Particle>::iterator p;
+	for (p = particles.begin(); p != particles.end(); p++)
+	{
+		if ((*p).GetMoveState())
+			pinnedCount++;
+		if ((*p).IsBroken())
+			torn = true;
+	}
+}
+
+// builds and factors the projective dynamics system
+template<typename V>
+void BasicCloth<V>::FactorProjective()
+{
+	factorDirty = false;
+
+	// order the particles along the shortest side of the cloth, which keeps the band of the matrix narrow
+	solverIndex.resize(particles.size());
+	for (int x = 0; x < particlesWidth; x++)
+		for (int y = 0; y < particlesHeight; y++)
+			solverIndex[x + y * particlesWidth] = (particlesWidth <= particlesHeight) ? x + y * particlesWidth : y + x * particlesHeight;
+
+	// find the bandwidth of the matrix
+	int band = 0;
+	typename std::vector<Constraint>::iterator constraint;
+	for (constraint = constraints.begin(); constraint != constraints.end(); constraint++)
+	{
+		int i1 = solverIndex[(*constraint).p1 - &particles[0]], i2 = solverIndex[(*constraint).p2 - &particles[0]];
+		band = std::max(band, abs(i1 - i2));
+	}
+	system.Resize((int)particles.size(), band);
+
+	// the inertia of the movable particles, pinned particles keep their position
+	for (size_t i = 0; i < particles.size(); i++)
+		system.Add(solverIndex[i], solverIndex[i], particles[i].GetMoveState() ? 1.0 : particles[i].GetMass() / (TIMESTEP2));
+
+	// every constraint couples the particles it connects, couplings with pinned particles move to the right hand side
+	for (constraint = constraints.begin(); constraint != constraints.end(); constraint++)
+	{
+		Particle *p1 = (*constraint).p1, *p2 = (*constraint).p2;
+		int i1 = solverIndex[p1 - &particles[0]], i2 = solverIndex[p2 - &particles[0]];
+		if (!p1->GetMoveState()) system.Add(i1, i1, pdStiffness);
+		if (!p2->GetMoveState()) system.Add(i2, i2, pdStiffness);
+		if (!p1->GetMoveState() && !p2->GetMoveState()) system.Add(i1, i2, -pdStiffness);
+	}
+
+	// fall back to the constraint iterations if the system can't be factored
+	if (!system.Factor())
+		projective = false;
+}
+
+// solves the constraints by alternating a local projection of every constraint and a global solve
+template<typename V>
+void BasicCloth<V>::SolveProjective()
+{
+	if (factorDirty)
+		FactorProjective();
+	if (!projective)
+		return;
+
+	// remember the predicted positions
+	inertia.resize(particles.size());
+	for (int c = 0; c < 3; c++)
+		rhs[c].resize(particles.size());
+	for (size_t i = 0; i < particles.size(); i++)
+		inertia[i] = particles[i].GetPos();
+
+	typename std::vector<Constraint>::iterator constraint;
+	float omega = 1.0f;
+	for (lastIter = 0; lastIter < constIter; lastIter++)
+	{
+		// the right hand side starts with the inertia of the particles, pinned particles keep their position
+		for (size_t i = 0; i < particles.size(); i++)
+		{
+			T weight = particles[i].GetMoveState() ? T(1) : (T)(particles[i].GetMass() / (TIMESTEP2));
+			for (int c = 0; c < 3; c++)
+				rhs[c][solverIndex[i]] = weight * inertia[i].f[c];
+		}
+
+		// local step, project every constraint on its rest length and add it to the right hand side
+		T maxError = 0, sumError = 0;
+		for (constraint = constraints.begin(); constraint != constraints.end(); constraint++)
+		{
+			Particle *p1 = (*constraint).p1, *p2 = (*constraint).p2;
+			V spring = p1->GetPos() - p2->GetPos();
+			T restDist = (*constraint).GetRestDist(), currDist = spring.Length();
+
+			// if the constraint stretched too far, break it and refactor the system next update
+			if (tearable && currDist > restDist * stretch)
+			{
+				(*constraint).Break(tearKey);
+				backupConstraints.push_back(*constraint);
+				constraints.erase(constraint--);
+				torn = factorDirty = tethersDirty = true;
+				continue;
+			}
+
+			// keep track of the residual of this iteration
+			T error = std::abs(currDist - restDist) / restDist;
+			maxError = std::max(maxError, error);
+			sumError += error * error;
+
+			V projection = (currDist > 0.0f) ? spring * (restDist / currDist) : V(0, 0, 0);
+			int i1 = solverIndex[p1 - &particles[0]], i2 = solverIndex[p2 - &particles[0]];
+			for (int c = 0; c < 3; c++)
+			{
+				if (!p1->GetMoveState()) rhs[c][i1] += pdStiffness * (projection.f[c] + (p2->GetMoveState() ? p2->GetPos().f[c] : 0.0f));
+				if (!p2->GetMoveState()) rhs[c][i2] += pdStiffness * (-projection.f[c] + (p1->GetMoveState() ? p1->GetPos().f[c] : 0.0f));
+			}
+		}
+		maxResidual = (float)maxError;
+		rmsResidual = constraints.size() ? (float)std::sqrt(sumError / constraints.size()) : 0.0f;
+
+		// stop once the constraints are satisfied well enough, the residual is measured before the global step of this iteration
+		if (Converged(lastIter))
+			break;
+
+		// global step, solve the system for every coordinate and move the particles to the solution
+		for (int c = 0; c < 3; c++)
+			system.Solve(rhs[c]);
+		for (size_t i = 0; i < particles.size(); i++)
+		{
+			int row = solverIndex[i];
+			particles[i].OffsetPos(V((T)rhs[0][row], (T)rhs[1][row], (T)rhs[2][row]) - particles[i].GetPos());
+		}
+
+		// extrapolate the positions towards the solution
+		if (chebyshev)
+			AccelerateIteration(lastIter, omega);
+	}
+}
+
+// builds a tether from every pinned particle to every particle it is connected to, with the geodesic distance as range
+template<typename V>
+void BasicCloth<V>::BuildTethers()
+{
+	tethersDirty = false;
+	tetherAnchor.clear();
+	tetherParticle.clear();
+	tetherDist.clear();
+
+	// gather the neighbors of every particle along the remaining constraints
+	int n = (int)particles.size();
+	std::vector<std::vector<std::pair<int, T> > > neighbors(n);
+	typename std::vector<Constraint>::iterator constraint;
+	for (constraint = constraints.begin(); constraint != constraints.end(); constraint++)
+	{
+		int a = (int)((*constraint).p1 - &particles[0]), b = (int)((*constraint).p2 - &particles[0]);
+		neighbors[a].push_back(std::make_pair(b, (*constraint).GetRestDist()));
+		neighbors[b].push_back(std::make_pair(a, (*constraint).GetRestDist()));
+	}
+
+	// find the shortest path along the cloth from every pinned particle to the movable particles
+	std::vector<T> dist(n);
+	for (int anchor = 0; anchor < n; anchor++)
+	{
+		if (!particles[anchor].GetMoveState())
+			continue;
+
+		std::fill(dist.begin(), dist.end(), FLT_MAX);
+		std::priority_queue<std::pair<T, int>, std::vector<std::pair<T, int> >, std::greater<std::pair<T, int> > > queue;
+		dist[anchor] = 0;
+		queue.push(std::make_pair(T(0), anchor));
+		while (!queue.empty())
+		{
+			std::pair<T, int> top = queue.top();
+			queue.pop();
+			if (top.first > dist[top.second])
+				continue;
+
+			for (size_t i = 0; i < neighbors[top.second].size(); i++)
+			{
+				std::pair<int, T> &neighbor = neighbors[top.second][i];
+				if (top.first + neighbor.second < dist[neighbor.first])
+				{
+					dist[neighbor.first] = top.first + neighbor.second;
+					queue.push(std::make_pair(dist[neighbor.first], neighbor.first));
+				}
+			}
+		}
+
+		// tether the reachable movable particles to the pinned particle
+		for (int i = 0; i < n; i++)
+			if (!particles[i].GetMoveState() && dist[i] < FLT_MAX)
+			{
+				tetherAnchor.push_back(anchor);
+				tetherParticle.push_back(i);
+				tetherDist.push_back(dist[i] * tetherSlack);
+			}
+	}
+}
+
+// pulls the particles back within the range of their tethers, the pinned particles don't move
+template<typename V>
+void BasicCloth<V>::SatisfyTethers()
+{
+	if (tethersDirty)
+		BuildTethers();
+
+	// the tethers of a pinned particle are stored together, and every particle is tethered to it at most once,
+	// so the tethers of an anchor are independent of each other and are satisfied as one batch
+	int count = (int)tetherDist.size();
+	tetherX.resize(count);
+	tetherY.resize(count);
+	tetherZ.resize(count);
+	tetherScale.resize(count);
+	for (int begin = 0, end; begin < count; begin = end)
+	{
+		V anchor = particles[tetherAnchor[begin]].GetPos();
+		for (end = begin; end < count && tetherAnchor[end] == tetherAnchor[begin]; end++)
+		{
+			// gather the offsets of the tethered particles to the anchor
+			V d = particles[tetherParticle[end]].GetPos() - anchor;
+			tetherX[end] = d.f[0];
+			tetherY[end] = d.f[1];
+			tetherZ[end] = d.f[2];
+		}
+
+		// calculate how far the particles are pulled back, 4 tethers at the time if the cloth is simulated in float
+		const T *x = &tetherX[0], *y = &tetherY[0], *z = &tetherZ[0];
+		T *scale = &tetherScale[0];
+		TetherScales(x, y, z, &tetherDist[0], scale, begin, end);
+
+		// scatter the corrections to the particles that are out of range
+		for (int i = begin; i < end; i++)
+			if (scale[i] != 0.0f)
+				particles[tetherParticle[i]].OffsetPos(V(x[i], y[i], z[i]) * scale[i]);
+	}
+}
+
+// updates the particle positions and tracks the kinetic energy per tile
+template<typename V>
+void BasicCloth<V>::IntegrateParticles()
+{
+	typename std::vector<Tile>::iterator tile;
+	for (tile = tiles.begin(); tile != tiles.end(); tile++)
+		(*tile).energy = 0;
+
+	for (int x = 0; x < particlesWidth; x++)
+		for (int y = 0; y < particlesHeight; y++)
+		{
+			Particle *p = GetParticle(x, y);
+			if (p->IsSleeping())
+				continue;
+
+			// the velocity is taken after the constraints are satisfied, before gravity is integrated
+			V v = p->GetVelocity();
+			tiles[GetTileIndex(x, y)].energy += (float)v.Dot(v);
+			p->Update(damping);
+		}
+}
+
+// multiplies a vector with the linearized spring stiffness, the result is the negated spring force differential
+template<typename V>
+void BasicCloth<V>::ApplyStiffness(std::vector<V> &in, std::vector<V> &out)
+{
+	std::fill(out.begin(), out.end(), V(0, 0, 0));
+	for (size_t i = 0; i < constraints.size(); i++)
+	{
+		// the stiffness is full along the spring, and scaled by the bend factor across the spring
+		int a = (int)(constraints[i].p1 - &particles[0]), b = (int)(constraints[i].p2 - &particles[0]);
+		V delta = in[a] - in[b];
+		V force = (delta * springBend[i] + springDir[i] * ((1.0f - springBend[i]) * springDir[i].Dot(delta))) * implicitStiffness;
+		out[a] += force;
+		out[b] -= force;
+	}
+}
+
+// updates the cloth with implicit euler, solving the linearized system with a preconditioned conjugate gradient
+// all quantities are expressed per basic timestep, so the implicit timestep is implicitScale
+template<typename V>
+void BasicCloth<V>::UpdateImplicit()
+{
+	size_t n = particles.size();
+	T h = implicitScale;
+	velocity.resize(n); cgRhs.resize(n); cgResidual.resize(n); cgDir.resize(n); cgTemp.resize(n); cgPrecond.resize(n);
+
+	// the current velocities and the external forces, scaled to the basic timestep like in the verlet integration
+	for (size_t i = 0; i < n; i++)
+	{
+		velocity[i] = particles[i].GetVelocity();
+		cgRhs[i] = particles[i].GetAcceleration() * (particles[i].GetMass() * (TIMESTEP2));
+		cgPrecond[i] = particles[i].GetMass();
+	}
+
+	// linearize the springs and add their forces, tearing the ones that are stretched too far
+	T maxError = 0, sumError = 0;
+	springDir.resize(constraints.size());
+	springBend.resize(constraints.size());
+	for (size_t i = 0; i < constraints.size(); i++)
+	{
+		Particle *p1 = constraints[i].p1, *p2 = constraints[i].p2;
+		V spring = p1->GetPos() - p2->GetPos();
+		T restDist = constraints[i].GetRestDist(), currDist = spring.Length();
+
+		if (tearable && currDist > restDist * stretch)
+		{
+			constraints[i].Break(tearKey);
+			backupConstraints.push_back(constraints[i]);
+			constraints.erase(constraints.begin() + i--);
+			torn = tethersDirty = true;
+			continue;
+		}
+
+		T error = std::abs(currDist - restDist) / restDist;
+		maxError = std::max(maxError, error);
+		sumError += error * error;
+
+		// compressed springs get no transverse stiffness, which keeps the system positive definite
+		springDir[i] = (currDist > 0.0f) ? spring / currDist : V(0, 0, 0);
+		springBend[i] = (currDist > 0.0f) ? std::max(T(0), 1 - restDist / currDist) : 0;
+
+		V force = springDir[i] * (implicitStiffness * (restDist - currDist));
+		int a = (int)(p1 - &particles[0]), b = (int)(p2 - &particles[0]);
+		cgRhs[a] += force;
+		cgRhs[b] -= force;
+
+		// the diagonal of the system, averaged over the coordinates
+		T diagonal = h * h * implicitStiffness * (springBend[i] + (1.0f - springBend[i]) / 3.0f);
+		cgPrecond[a] += diagonal;
+		cgPrecond[b] += diagonal;
+	}
+	springDir.resize(constraints.size());
+	springBend.resize(constraints.size());
+	maxResidual = (float)maxError;
+	rmsResidual = constraints.size() ? (float)std::sqrt(sumError / constraints.size()) : 0.0f;
+
+	// the right hand side is h * (f + h * K * v), the stiffness matrix K is the negated ApplyStiffness
+	ApplyStiffness(velocity, cgTemp);
+	for (size_t i = 0; i < n; i++)
+	{
+		cgRhs[i] = (cgRhs[i] - cgTemp[i] * h) * h;
+		cgPrecond[i] = 1.0f / cgPrecond[i];
+	}
+
+	// solve (M - h^2 * K) * dv = rhs, the velocity of fixed and sleeping particles doesn't change
+	// the change in velocity starts at zero, so the residual starts as the right hand side
+	std::vector<V> &dv = cgTemp;
+	for (size_t i = 0; i < n; i++)
+	{
+		bool locked = particles[i].GetMoveState() || particles[i].IsSleeping();
+		dv[i] = V(0, 0, 0);
+		cgResidual[i] = locked ? V(0, 0, 0) : cgRhs[i];
+		cgDir[i] = cgResidual[i] * cgPrecond[i];
+	}
+
+	T rz = 0, rhsNorm = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		rz += cgResidual[i].Dot(cgDir[i]);
+		rhsNorm += cgResidual[i].Dot(cgResidual[i]);
+	}
+
+	std::vector<V> &product = cgRhs;
+	for (lastIter = 0; lastIter < cgIter && rhsNorm > 0.0f; lastIter++)
+	{
+		// multiply the search direction with the system
+		ApplyStiffness(cgDir, product);
+		T pAp = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			bool locked = particles[i].GetMoveState() || particles[i].IsSleeping();
+			product[i] = locked ? V(0, 0, 0) : cgDir[i] * particles[i].GetMass() + product[i] * (h * h);
+			pAp += cgDir[i].Dot(product[i]);
+		}
+		if (pAp <= 0.0f)
+			break;
+
+		// step along the search direction
+		T alpha = rz / pAp, rNorm = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			dv[i] += cgDir[i] * alpha;
+			cgResidual[i] -= product[i] * alpha;
+			rNorm += cgResidual[i].Dot(cgResidual[i]);
+		}
+
+		// stop once the residual is small enough
+		if (rNorm < cgTolerance * cgTolerance * rhsNorm)
+		{
+			lastIter++;
+			break;
+		}
+
+		// update the search direction with the preconditioned residual
+		T rzNew = 0;
+		for (size_t i = 0; i < n; i++)
+			rzNew += cgResidual[i].Dot(cgResidual[i] * cgPrecond[i]);
+		T beta = rzNew / rz;
+		rz = rzNew;
+		for (size_t i = 0; i < n; i++)
+			cgDir[i] = cgResidual[i] * cgPrecond[i] + cgDir[i] * beta;
+	}
+
+	// move the particles with the new velocity and track the kinetic energy per tile
+	typename std::vector<Tile>::iterator tile;
+	for (tile = tiles.begin(); tile != tiles.end(); tile++)
+		(*tile).energy = 0;
+
+	for (int x = 0; x < particlesWidth; x++)
+		for (int y = 0; y < particlesHeight; y++)
+		{
+			int i = x + y * particlesWidth;
+			V v = (velocity[i] + dv[i]) * (1.0f - damping);
+			particles[i].SetState(particles[i].GetPos() + v * h, v);
+			if (!particles[i].IsSleeping())
+				tiles[GetTileIndex(x, y)].energy += (float)v.Dot(v);
+		}
+}
+
+// extrapolates the particle positions after a constraint iteration, omega is the chebyshev weight of the iteration
+template<typename V>
+void BasicCloth<V>::AccelerateIteration(int iter, float &omega)
+{
+	// estimate the spectral radius from the average convergence rate of the plain iterations
+	if (autoSpectralRadius)
+	{
+		if (iter == 0)
+			firstResidual = rmsResidual;
+		else if (iter == chebyshevDelay - 1 && firstResidual > 0.0f && rmsResidual > 0.0f)
+		{
+			float rate = powf(rmsResidual / firstResidual, 1.0f / iter);
+			spectralRadius = std::min(0.9f * spectralRadius + 0.1f * rate, 0.99f);
+		}
+	}
+
+	// start the history after the first iteration, the delay of at least two plain iterations makes up for the missing position
+	if (iter == 0)
+	{
+		iterPos.resize(particles.size());
+		prevIterPos.resize(particles.size());
+		for (size_t i = 0; i < particles.size(); i++)
+			iterPos[i] = prevIterPos[i] = particles[i].GetPos();
+		return;
+	}
+
+	// calculate the weight of this iteration, the plain iterations aren't extrapolated
+	float rho2 = spectralRadius * spectralRadius;
+	if (iter < chebyshevDelay)
+		omega = 1.0f;
+	else if (iter == chebyshevDelay)
+		omega = 2.0f / (2.0f - rho2);
+	else
+		omega = 4.0f / (4.0f - rho2 * omega);
+
+	// extrapolate from the position two iterations ago, fixed and sleeping particles aren't moved
+	for (size_t i = 0; i < particles.size(); i++)
+	{
+		V pos = particles[i].GetPos();
+		if (omega != 1.0f)
+		{
+			V accelerated = (pos - prevIterPos[i]) * omega + prevIterPos[i];
+			particles[i].OffsetPos(accelerated - pos);
+		}
+
+		prevIterPos[i] = iterPos[i];
+		iterPos[i] = particles[i].GetPos();
+	}
+}
+
 /* Public methods */
 
 // draw the triangles in a smooth shaded format
-// four particles in a grid are connected via 2 triangles, diagonal from bottom left to top right
-void Cloth::DrawShaded()
+// builds the triangles with their smooth normals and colors in the draw arrays, without drawing them
+template<typename V>
+template<bool AllTriangles>
+void BasicCloth<V>::BuildDrawArraysKernel()
 {
 	// reset normals
-	std::vector<Particle>::iterator p;
+	typename std::vector<Particle>::iterator p;
 	for (p = particles.begin(); p != particles.end(); p++)
 		(*p).ResetNormal();
 
 	// create smooth normals by adding up all the normals from every vertex (connected vertices are added twice)
+	// the normals of the triangles were already calculated after the last update
 	for (int x = 0; x < particlesWidth - 1; x++)
 		for (int y = 0; y < particlesHeight - 1; y++)
 		{
-			Vec3 normal = CalcTriangleNormal(GetParticle(x + 1, y), GetParticle(x, y), GetParticle(x, y + 1));
+			int quad = 2 * (x + y * (particlesWidth - 1));
+			V normal = faceNormals[quad];
 			GetParticle(x + 1, y)->AddToNormal(normal);
 			GetParticle(x, y)->AddToNormal(normal);
 			GetParticle(x, y + 1)->AddToNormal(normal);
 
-			normal = CalcTriangleNormal(GetParticle(x + 1, y + 1), GetParticle(x + 1, y), GetParticle(x, y + 1));
+			normal = faceNormals[quad + 1];
 			GetParticle(x + 1, y + 1)->AddToNormal(normal);
 			GetParticle(x + 1, y)->AddToNormal(normal);
 			GetParticle(x, y + 1)->AddToNormal(normal);
 		}
 
-
-	// draw the triangles
-	glBegin(GL_TRIANGLES);
+	// add the triangles, the colors and texture coordinates are only rebuilt if other triangles are drawn than before
+	drawVertices.clear();
+	drawNormals.clear();
+	if (colorsDirty)
+	{
+		drawColors.clear();
+		drawUVs.clear();
+	}
 	for (int x = 0; x < particlesWidth - 1; x++)
 		for (int y = 0; y < particlesHeight - 1; y++)
 		{
-			// this sets the color of the cloth
-			Vec3 color = ClothPattern(x, y);
+			// the baked color of the quad
+			const Vec3 &color = cellColors[x + y * (particlesWidth - 1)];
 
 			// get the particles that need to be drawn
 			Particle *p1 = GetParticle(x, y);
@@ -118,45 +970,179 @@ void Cloth::DrawShaded()
 			Particle *p4 = GetParticle(x + 1, y + 1);
 
 			// make sure the particles aren't part of a broken constraint before drawing the triangles
-			if (showTears || (!p3->IsBroken() || !p1->IsBroken() || !p2->IsBroken()))
-				DrawTriangle(p3, p1, p2, color);
-			if (showTears || (!p4->IsBroken() || !p3->IsBroken() || !p2->IsBroken()))
-				DrawTriangle(p4, p3, p2, color);
+			if (AllTriangles || (!p3->IsBroken() || !p1->IsBroken() || !p2->IsBroken()))
+				AddTriangle(p3, p1, p2, color);
+			if (AllTriangles || (!p4->IsBroken() || !p3->IsBroken() || !p2->IsBroken()))
+				AddTriangle(p4, p3, p2, color);
 		}
-	glEnd();
+
+	// the new colors are uploaded when the cloth is drawn
+	if (colorsDirty)
+	{
+		colorsDirty = false;
+		colorsChanged = true;
+	}
+}
+
+// builds the draw arrays, every triangle is drawn if the tears are shown or if the cloth isn't torn
+template<typename V>
+void BasicCloth<V>::BuildDrawArrays()
+{
+	if (showTears || !torn)
+		BuildDrawArraysKernel<true>();
+	else
+		BuildDrawArraysKernel<false>();
+}
+
+// draws the triangles in the draw arrays
+template<typename V>
+void BasicCloth<V>::DrawArrays()
+{
+	if (drawVertices.empty())
+		return;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, &drawVertices[0]);
+	glNormalPointer(GL_FLOAT, 0, &drawNormals[0]);
+
+	// the colors and texture coordinates stay on the gpu, and are only uploaded again when they changed
+	if (!colorBuffer)
+	{
+		glGenBuffers(1, &colorBuffer);
+		glGenBuffers(1, &uvBuffer);
+	}
+	if (colorsChanged)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+		glBufferData(GL_ARRAY_BUFFER, drawColors.size() * sizeof(float), &drawColors[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
+		glBufferData(GL_ARRAY_BUFFER, drawUVs.size() * sizeof(float), &drawUVs[0], GL_STATIC_DRAW);
+		colorsChanged = false;
+	}
+
+	// a textured cloth is lit white, otherwise it has the colors of the pattern
+	if (texture)
+	{
+		glEnable(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
+		glTexCoordPointer(2, GL_FLOAT, 0, (void*)0);
+		glColor3f(1.0f, 1.0f, 1.0f);
+	}
+	else
+	{
+		glEnableClientState(GL_COLOR_ARRAY);
+		glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+		glColorPointer(3, GL_FLOAT, 0, (void*)0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(drawVertices.size() / 3));
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	if (texture)
+	{
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glDisable(GL_TEXTURE_2D);
+	}
+}
+
+// draw the triangles in a smooth shaded format
+template<typename V>
+void BasicCloth<V>::DrawShaded()
+{
+	BuildDrawArrays();
+	DrawArrays();
 }
 
 // updates the cloth by satisfying the constraints and updating the particle positions
-void Cloth::Update()
+template<typename V>
+void BasicCloth<V>::Update()
 {
-	// iterate over the constraints several times and satisfy them
-	// if the constraint stretched too far, break it
-	std::vector<Constraint>::iterator constraint;
-	for (int i = 0; i < constIter; i++)
-		for (constraint = constraints.begin(); constraint != constraints.end(); constraint++)
-			if ((*constraint).SatisfyConstraint(tearable, stretch))
-			{
-				// save a copy of the broken constraint
-				backupConstraints.push_back(*constraint);
-				constraints.erase(constraint--);
-			}
+	// every update tears with its own key, the drawn triangles change when the cloth tears
+	step++;
+	tearKey = Random::Hash(seed, step);
+	size_t tears = backupConstraints.size();
 
-	// update the particles
-	std::vector<Particle>::iterator particle;
-	for (particle = particles.begin(); particle != particles.end(); particle++)
-		(*particle).Update();
+	// a cloth that is completely asleep doesn't need to be updated
+	if (awakeTiles == 0)
+	{
+		lastIter = 0;
+		return;
+	}
+
+	if (implicit)
+	{
+		// integrate the springs and forces implicitly with a larger timestep
+		UpdateImplicit();
+	}
+	else if (projective)
+	{
+		// predict the positions of the particles and solve the constraints implicitly
+		IntegrateParticles();
+		SolveProjective();
+		if (tethers)
+			SatisfyTethers();
+	}
+	else
+	{
+		// solve the coarse grids first, so corrections travel across the cloth in a few iterations
+		if (multigrid)
+			SolveHierarchy();
+
+		// satisfy the constraints and tethers, and update the particles
+		SolveConstraints();
+		if (tethers)
+			SatisfyTethers();
+		IntegrateParticles();
+	}
+
+	// put the resting parts of the cloth to sleep
+	UpdateSleeping();
+	if (backupConstraints.size() != tears)
+		colorsDirty = true;
+}
+
+// calculates the normals of all the triangles, only reads the particle positions
+template<typename V>
+void BasicCloth<V>::UpdateNormals()
+{
+	faceNormals.resize(2 * (particlesWidth - 1) * (particlesHeight - 1));
+	for (int x = 0; x < particlesWidth - 1; x++)
+		for (int y = 0; y < particlesHeight - 1; y++)
+			UpdateQuadNormals(x, y);
+}
+
+// uses an image with 4 bytes per pixel as the pattern, the image is stretched over the cloth
+template<typename V>
+void BasicCloth<V>::SetPatternImage(const unsigned char *pixels, int w, int h)
+{
+	pattern = Pattern::Image;
+	patternImage.assign(pixels, pixels + 4 * w * h);
+	imageWidth = w;
+	imageHeight = h;
+	BakePattern();
 }
 
 // adds a force to all the particles in the cloth
-void Cloth::AddForce(const Vec3 direction)
+template<typename V>
+void BasicCloth<V>::AddForce(const Vec3 direction)
 {
-	std::vector<Particle>::iterator particle;
+	V force = V(direction);
+	typename std::vector<Particle>::iterator particle;
 	for (particle = particles.begin(); particle != particles.end(); particle++)
-		(*particle).AddForce(direction);
+		(*particle).AddForce(force);
 }
 
-// add the wind force to all the particles, seperately added since the final force is proportional to the triangle area from the wind direction
-void Cloth::AddWindForce(const Vec3 direction)
+// add the wind force to all the particles, seperately added since the final force depends on the triangle area and its velocity relative to the wind
+template<typename V>
+template<bool Torn>
+void BasicCloth<V>::AddWindForceKernel(const V wind)
 {
 	for (int x = 0; x < particlesWidth - 1; x++)
 		for (int y = 0; y < particlesHeight - 1; y++)
@@ -168,15 +1154,28 @@ void Cloth::AddWindForce(const Vec3 direction)
 			Particle *p4 = GetParticle(x + 1, y + 1);
 
 			// make sure the particles aren't part of a broken constraint before applying the impulses
-			if (showTears || (!p3->IsBroken() || !p1->IsBroken() || !p2->IsBroken()))
-				AddForcesToTriangle(p3, p1, p2, direction);
-			if (showTears || (!p4->IsBroken() || !p3->IsBroken() || !p2->IsBroken()))
-				AddForcesToTriangle(p4, p3, p2, direction);
+			// this doesn't depend on showing the tears, so the simulation is the same whether they are shown or not
+			int quad = 2 * (x + y * (particlesWidth - 1));
+			if (!Torn || (!p3->IsBroken() || !p1->IsBroken() || !p2->IsBroken()))
+				AddForcesToTriangle(p3, p1, p2, faceNormals[quad], wind);
+			if (!Torn || (!p4->IsBroken() || !p3->IsBroken() || !p2->IsBroken()))
+				AddForcesToTriangle(p4, p3, p2, faceNormals[quad + 1], wind);
 		}
 }
 
+// adds the wind to every triangle, the broken particles are only checked once the cloth is torn
+template<typename V>
+void BasicCloth<V>::AddWindForce(const Vec3 wind)
+{
+	if (torn)
+		AddWindForceKernel<true>(V(wind));
+	else
+		AddWindForceKernel<false>(V(wind));
+}
+
 // switches a specific corner state
-void Cloth::SwitchCorner(int corner)
+template<typename V>
+void BasicCloth<V>::SwitchCorner(int corner)
 {
 	// do this for 3 pixels at the time
 	for (int i = 0; i < 3; i++)
@@ -208,10 +1207,17 @@ void Cloth::SwitchCorner(int corner)
 		else
 			p->MakeMovable();
 	}
+	CountFeatures();
+
+	// the cloth needs to settle again, with a different system for the projective dynamics and different tethers
+	WakeAll();
+	factorDirty = true;
+	tethersDirty = true;
 }
 
 // reset the position of the cloth and cloth state
-void Cloth::ResetCloth()
+template<typename V>
+void BasicCloth<V>::ResetCloth()
 {
 	// reset all particles
 	for (int x = 0; x < particlesWidth; x++)
@@ -219,32 +1225,295 @@ void Cloth::ResetCloth()
 		{
 			// reset the positions
 			Vec3 pos = Vec3(width * (x / (float)particlesWidth), -height * (y / (float)particlesHeight), 0);
-			particles[x + y * particlesWidth] = Particle(pos + worldPos);
+			particles[x + y * particlesWidth] = Particle(V(pos + worldPos));
 
 			// reset the state of the particles
 			GetParticle(x, y)->SetToFixed();
 		}
 
-	// repair the constraints between all particles
+	// repair the constraints between all particles, in the order in which the cloth was built
 	constraints.insert(constraints.end(), backupConstraints.begin(), backupConstraints.end());
+	backupConstraints.clear();
+	std::sort(constraints.begin(), constraints.end(), [](Constraint &a, Constraint &b) { return a.GetId() < b.GetId(); });
+	torn = false;
+	factorDirty = tethersDirty = true;
+
+	// an estimated spectral radius starts over as well
+	if (autoSpectralRadius)
+		spectralRadius = 0.9f;
+
+	// restart counting the updates, so a reset cloth tears the same as a new one
+	step = 0;
+	tearKey = Random::Hash(seed, step);
 
 	// set the top 2 corners so that the cloth doesn't immediately fall again
 	SwitchCorner(1); SwitchCorner(2);
+	UpdateNormals();
+	colorsDirty = true;
+}
+
+// copies the positions of all the particles into a buffer of 3 floats or doubles per particle
+template<typename V>
+void BasicCloth<V>::CopyPositions(float *out)
+{
+	CopyParticlePositions(particles, out);
+}
+
+// the same in double, to compare the precisions
+template<typename V>
+void BasicCloth<V>::CopyPositions(double *out)
+{
+	CopyParticlePositions(particles, out);
+}
+
+// copies whether every particle is part of a broken constraint into a buffer of 1 byte per particle
+template<typename V>
+void BasicCloth<V>::CopyBroken(unsigned char *out)
+{
+	for (size_t i = 0; i < particles.size(); i++)
+		out[i] = particles[i].IsBroken() ? 1 : 0;
+}
+
+// returns the kinetic energy of the cloth
+template<typename V>
+float BasicCloth<V>::GetKineticEnergy()
+{
+	T energy = 0;
+	typename std::vector<Particle>::iterator p;
+	for (p = particles.begin(); p != particles.end(); p++)
+	{
+		V v = (*p).GetVelocity();
+		energy += 0.5f * (*p).GetMass() * v.Dot(v);
+	}
+	return (float)energy;
+}
+
+// returns the largest stretch of a constraint relative to its rest length
+template<typename V>
+float BasicCloth<V>::GetMaxStretch()
+{
+	T maxStretch = 0;
+	typename std::vector<Constraint>::iterator constraint;
+	for (constraint = constraints.begin(); constraint != constraints.end(); constraint++)
+	{
+		T length = ((*constraint).p2->GetPos() - (*constraint).p1->GetPos()).Length();
+		maxStretch = std::max(maxStretch, length / (*constraint).GetRestDist());
+	}
+	return (float)maxStretch;
+}
+
+// saves the state of the particles and the remaining constraints to a binary file, optionally compressed
+// the data is stored per attribute instead of per particle, which compresses better
+template<typename V>
+bool BasicCloth<V>::SaveState(const char* fileName, bool compress)
+{
+	std::vector<unsigned char> raw;
+	size_t n = particles.size();
+	raw.reserve(n * (6 * sizeof(float) + 1) + constraints.size() * 2 * sizeof(unsigned int));
+
+	for (size_t i = 0; i < n; i++) AppendVector(raw, particles[i].GetPos());
+	for (size_t i = 0; i < n; i++) AppendVector(raw, particles[i].GetPrevPos());
+	for (size_t i = 0; i < n; i++) raw.push_back((particles[i].GetMoveState() ? 1 : 0) | (particles[i].IsBroken() ? 2 : 0));
+
+	// the constraints are stored as the indices of the particles they connect
+	typename std::vector<Constraint>::iterator constraint;
+	for (constraint = constraints.begin(); constraint != constraints.end(); constraint++)
+	{
+		unsigned int pair[2] = { (unsigned int)((*constraint).p1 - &particles[0]), (unsigned int)((*constraint).p2 - &particles[0]) };
+		AppendBytes(raw, pair, sizeof(pair));
+	}
+
+	StateHeader header = { { 'C', 'L', 'T', 'H' }, STATEVERSION, 0, (unsigned int)particlesWidth, (unsigned int)particlesHeight,
+		(unsigned int)constraints.size(), (unsigned int)raw.size(), (unsigned int)raw.size(), seed, step };
+	std::vector<unsigned char> *stored = &raw;
+
+	// compress the data if zlib is available, otherwise the state is saved uncompressed
+#ifdef USE_ZLIB
+	std::vector<unsigned char> packed;
+	if (compress)
+	{
+		uLongf packedSize = compressBound((uLong)raw.size());
+		packed.resize(packedSize);
+		if (compress2(&packed[0], &packedSize, &raw[0], (uLong)raw.size(), Z_BEST_SPEED) == Z_OK)
+		{
+			packed.resize(packedSize);
+			header.compressed = 1;
+			header.storedSize = (unsigned int)packedSize;
+			stored = &packed;
+		}
+	}
+#else
+	(void)compress;
+#endif
+
+	std::ofstream file(fileName, std::ios::out | std::ios::binary);
+	if (!file.is_open())
+		return false;
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)&(*stored)[0], stored->size());
+	return file.good();
+}
+
+// restores a state saved by a cloth with the same resolution, returns false if the file can't be used
+template<typename V>
+bool BasicCloth<V>::LoadState(const char* fileName)
+{
+	// read and check the header
+	std::ifstream file(fileName, std::ios::in | std::ios::binary);
+	StateHeader header;
+	if (!file.read((char*)&header, sizeof(header)))
+		return false;
+	if (memcmp(header.magic, "CLTH", 4) != 0 || header.version != STATEVERSION ||
+		header.width != (unsigned int)particlesWidth || header.height != (unsigned int)particlesHeight)
+		return false;
+
+	size_t n = particles.size();
+	size_t rawSize = n * (6 * sizeof(float) + 1) + header.constraintCount * 2 * sizeof(unsigned int);
+	if (header.rawSize != rawSize)
+		return false;
+
+	std::vector<unsigned char> raw(header.storedSize);
+	if (header.storedSize && !file.read((char*)&raw[0], header.storedSize))
+		return false;
+
+	// decompress the data, which is only possible if zlib is available
+	if (header.compressed)
+	{
+#ifdef USE_ZLIB
+		std::vector<unsigned char> unpacked(rawSize);
+		uLongf unpackedSize = (uLongf)rawSize;
+		if (uncompress(&unpacked[0], &unpackedSize, &raw[0], (uLong)raw.size()) != Z_OK || unpackedSize != rawSize)
+			return false;
+		raw.swap(unpacked);
+#else
+		return false;
+#endif
+	}
+	else if (raw.size() != rawSize)
+		return false;
+
+	// every saved constraint should still exist, either as a remaining or as a broken constraint
+	std::map<std::pair<int, int>, Constraint*> pool;
+	typename std::vector<Constraint>::iterator constraint;
+	for (constraint = constraints.begin(); constraint != constraints.end(); constraint++)
+		pool[std::make_pair((int)((*constraint).p1 - &particles[0]), (int)((*constraint).p2 - &particles[0]))] = &(*constraint);
+	for (constraint = backupConstraints.begin(); constraint != backupConstraints.end(); constraint++)
+		pool[std::make_pair((int)((*constraint).p1 - &particles[0]), (int)((*constraint).p2 - &particles[0]))] = &(*constraint);
+
+	const unsigned char *pairs = &raw[n * (6 * sizeof(float) + 1)];
+	std::vector<Constraint> alive;
+	alive.reserve(header.constraintCount);
+	for (unsigned int i = 0; i < header.constraintCount; i++)
+	{
+		unsigned int pair[2];
+		memcpy(pair, pairs + i * sizeof(pair), sizeof(pair));
+		typename std::map<std::pair<int, int>, Constraint*>::iterator found = pool.find(std::make_pair((int)pair[0], (int)pair[1]));
+		if (found == pool.end() || found->second == NULL)
+			return false;
+		alive.push_back(*found->second);
+		found->second = NULL;
+	}
+
+	// the constraints that weren't saved are broken
+	std::vector<Constraint> broken;
+	typename std::map<std::pair<int, int>, Constraint*>::iterator entry;
+	for (entry = pool.begin(); entry != pool.end(); entry++)
+		if (entry->second)
+			broken.push_back(*entry->second);
+	constraints.swap(alive);
+	backupConstraints.swap(broken);
+
+	// restore the particles
+	const float *pos = (const float*)&raw[0], *prev = pos + 3 * n;
+	const unsigned char *flags = &raw[6 * n * sizeof(float)];
+	for (size_t i = 0; i < n; i++)
+		particles[i].Restore(V(pos[3 * i], pos[3 * i + 1], pos[3 * i + 2]), V(prev[3 * i], prev[3 * i + 1], prev[3 * i + 2]),
+			(flags[i] & 1) != 0, (flags[i] & 2) != 0);
+	CountFeatures();
+
+	// continue counting the updates where they were saved
+	seed = header.seed;
+	step = header.step;
+	tearKey = Random::Hash(seed, step);
+
+	// the cloth starts awake, with a new system, tethers and normals
+	WakeAll();
+	factorDirty = tethersDirty = true;
+	UpdateNormals();
+	colorsDirty = true;
+	return true;
 }
 
 // resolves collision with a sphere
-void Cloth::SphereCollision(const Vec3 center, const float radius)
+template<typename V>
+void BasicCloth<V>::SphereCollision(const Vec3 center, const float radius)
 {
-	// loop over all the particles
-	std::vector<Particle>::iterator particle;
-	for (particle = particles.begin(); particle != particles.end(); particle++)
+	// loop over all the particles, the center is converted to the precision of the cloth once
+	V c = V(center);
+	for (int i = 0; i < (int)particles.size(); i++)
 	{
-		// check how far the particle is away from the sphere center
-		Vec3 v = (*particle).GetPos() - center;
-		float l = v.Length();
+		// check how far the particle is away from the sphere center, a particle that already collided continues from its new position
+		Particle &particle = particles[i];
+		V pos = (collisionSlot[i] < 0) ? particle.GetPos() : collidedPos[collisionSlot[i]];
+		V v = pos - c;
+		T l = v.Length();
 
-		// if the particle is inside the sphere, project the particle on the surface of the sphere
+		// if the particle is inside the sphere, wake it up and project the particle on the surface of the sphere
 		if (v.Length() < radius)
-			(*particle).OffsetPos(v.Normalized()*(radius - l));
+		{
+			if (particle.IsSleeping())
+				WakeParticle(&particle);
+			if (!particle.IsMovable())
+				continue;
+			if (collisionSlot[i] < 0)
+			{
+				collisionSlot[i] = (int)collidedIndex.size();
+				collidedIndex.push_back(i);
+				collidedPos.push_back(pos);
+			}
+			collidedPos[collisionSlot[i]] = pos + v.Normalized()*(radius - l);
+		}
 	}
-}
\ No newline at end of file
+}
+
+// moves the particles that collided since the last call, and updates the normals of the triangles around them
+template<typename V>
+void BasicCloth<V>::ApplyCollisions()
+{
+	for (size_t i = 0; i < collidedIndex.size(); i++)
+		particles[collidedIndex[i]].SetPos(collidedPos[i]);
+
+	for (size_t i = 0; i < collidedIndex.size(); i++)
+	{
+		int x = collidedIndex[i] % particlesWidth, y = collidedIndex[i] / particlesWidth;
+		for (int qx = std::max(x - 1, 0); qx <= std::min(x, particlesWidth - 2); qx++)
+			for (int qy = std::max(y - 1, 0); qy <= std::min(y, particlesHeight - 2); qy++)
+				UpdateQuadNormals(qx, qy);
+		collisionSlot[collidedIndex[i]] = -1;
+	}
+	collidedIndex.clear();
+	collidedPos.clear();
+}
+
+// wakes up all the tiles of the cloth
+template<typename V>
+void BasicCloth<V>::WakeAll()
+{
+	typename std::vector<Tile>::iterator tile;
+	for (tile = tiles.begin(); tile != tiles.end(); tile++)
+	{
+		(*tile).energy = 0;
+		(*tile).quietSteps = 0;
+		(*tile).asleep = false;
+	}
+	awakeTiles = (int)tiles.size();
+
+	typename std::vector<Particle>::iterator particle;
+	for (particle = particles.begin(); particle != particles.end(); particle++)
+		(*particle).WakeUp();
+}
+
+// the cloth in float, in double for offline runs, and in float vectors padded for sse2
+template class BasicCloth<Vec3>;
+template class BasicCloth<Vec3d>;
+template class BasicCloth<Vec3a>;
\ No newline at end of file
@@ -1,15 +1,44 @@
-/* class for the cloth, made with a mass spring system */
-class Cloth
+/* class for the cloth, made with a mass spring system, templated on the vector type of its particles */
+// the cloth is simulated in the precision of its vectors, but is drawn, recorded and saved in float
+template<typename V>
+class BasicCloth
 {
 private:
+	// the scalar type, and the particles and constraints in the precision of the cloth
+	typedef typename V::Scalar T;
+	typedef BasicParticle<V> Particle;
+	typedef BasicConstraint<V> Constraint;
+
+	// a square region of particles that is put to sleep as a whole once it comes to rest
+	struct Tile
+	{
+		float energy;   // the kinetic energy of the particles in the tile during the last timestep
+		int quietSteps; // the amount of consecutive timesteps the tile has been quiet
+		bool asleep;    // is the tile sleeping or not
+	};
+
+	// a coarser grid of particles used to propagate corrections across the cloth faster
+	struct Level
+	{
+		int stride;                          // the distance in particles between the grid points
+		std::vector<int> xs, ys;             // the particle coordinates of the grid points
+		std::vector<Constraint> constraints; // the constraints between neighboring grid points
+		std::vector<V> correction;           // the displacement of the grid points during the coarse solve
+	};
+
 	Vec3 worldPos;                       // the position of the cloth in world
 	float width, height;                 // the width and height of the cloth
 	int particlesWidth, particlesHeight; // number of particles in the cloth
 
 	bool showTears;     			     // visualize the tears or not
 	bool tearable;                       // is the cloth tearable or not
+	bool torn;                           // is any particle part of a broken constraint
+	int pinnedCount;                     // the amount of pinned particles
 	float stretch;                       // the factor with which the particles can stretch the constraint before it breaks
 
+	float drag, lift;                    // aerodynamic coefficients used for the wind force on the triangles
+	float damping;                       // the fraction of the velocity that is lost every timestep
+
 	Pattern pattern;     // the cloth pattern
 	Vec3 color1, color2; // the color(s) of the cloth
 
@@ -20,32 +49,225 @@ private:
 	// the amount of constraint solving iterations of the cloth (less is softer, more is rigid)
 	int constIter;
 
+	// the solver stops iterating once the root mean square relative constraint violation is below the tolerance,
+	// but always does at least minIter and at most constIter iterations
+	float tolerance;
+	int minIter;
+
+	// the residual and amount of iterations of the last update
+	float maxResidual, rmsResidual;
+	int lastIter;
+
+	// chebyshev semi-iterative acceleration of the constraint iterations, starting after a few plain iterations
+	// the spectral radius is estimated from the convergence of the plain iterations if it is set automatically
+	bool chebyshev, autoSpectralRadius;
+	float spectralRadius, firstResidual;
+	int chebyshevDelay;
+	std::vector<V> iterPos, prevIterPos;    // the particle positions after the last two iterations
+
+	// hierarchy of coarser grids, solved from coarse to fine before the constraints of the cloth itself
+	bool multigrid;
+	int multigridIter;
+	std::vector<Level> levels;
+
+	// projective dynamics replaces the constraint iterations by alternating a local projection of every constraint
+	// and a global solve of a prefactored system, which only needs to be refactored if the constraints or pins change
+	bool projective, factorDirty;
+	float pdStiffness;
+	BandMatrix system;
+	std::vector<int> solverIndex;  // the row of every particle in the system
+	std::vector<V> inertia;        // the positions the particles would have without constraints
+	std::vector<double> rhs[3];    // the right hand side of the system for the x, y and z coordinates
+
+	// implicit backward euler integration, solving the linearized spring forces with a preconditioned conjugate gradient
+	// the timestep is a multiple of the basic timestep, the springs are linearized per constraint instead of in a matrix
+	bool implicit;
+	float implicitScale, implicitStiffness, cgTolerance;
+	int cgIter;
+	std::vector<V> springDir;                                  // the direction of every constraint
+	std::vector<T> springBend;                                 // the transverse stiffness factor of every constraint
+	std::vector<V> velocity, cgRhs, cgResidual, cgDir, cgTemp; // the vectors of the conjugate gradient solve
+	std::vector<T> cgPrecond;                                  // the inverse of the diagonal of the system
+
+	// long range attachments, which keep every particle within its geodesic rest distance of the pinned particles
+	// stored as separate arrays so they can be satisfied in a single pass
+	bool tethers, tethersDirty;
+	float tetherSlack;
+	std::vector<int> tetherAnchor, tetherParticle;
+	std::vector<T> tetherDist;
+	std::vector<T> tetherX, tetherY, tetherZ, tetherScale; // the offsets to the anchors and the corrections during a pass
+
+	// the seed of the cloth, the amount of updates since the cloth was built or reset, and the key of the current update
+	// which particle of a torn constraint is flagged is a hash of the key and the constraint, so it needs no shared state
+	// the random pattern has its own stream, which is only used when the pattern is baked so drawing never changes the simulation
+	unsigned long long seed, step, tearKey;
+	Random patternRandom;
+
+	// the image of the image pattern as 4 bytes per pixel, stretched over the cloth
+	std::vector<unsigned char> patternImage;
+	int imageWidth, imageHeight;
+
+	// the color of every quad of particles, baked from the pattern once instead of evaluating the pattern every frame
+	std::vector<Vec3> cellColors;
+
+	// the texture of the cloth, zero draws the pattern instead, and the texture coordinates of every particle on a grid
+	GLuint texture;
+	std::vector<float> gridUVs;
+
+	// the triangles of the cloth as vertex arrays, built separately from drawing them so many cloths can be built in parallel
+	// the colors and texture coordinates only change when the cloth tears, so they are only rebuilt and uploaded to buffers
+	// on the gpu when needed
+	std::vector<float> drawVertices, drawNormals, drawColors, drawUVs;
+	bool colorsDirty, colorsChanged;
+	GLuint colorBuffer, uvBuffer;
+
+	// the normals of the two triangles of every quad, their length is twice the area of the triangle
+	// computed once after every update, and shared by the wind of the next update and the drawing
+	std::vector<V> faceNormals;
+
+	// the particles moved by the collisions of the current update and their new positions
+	// the particles are only moved once all the collisions are resolved, so the normals can be computed in the meantime
+	std::vector<int> collisionSlot, collidedIndex;
+	std::vector<V> collidedPos;
+
+	// the tiles used to put resting regions of the cloth to sleep
+	int tilesWidth, tilesHeight;
+	std::vector<Tile> tiles;
+	int awakeTiles;
+
 	// method to get a certain particle and to set constraints between particles
 	Particle* GetParticle(int x, int y) { return &particles[x + y * particlesWidth]; }
-	void SetConstraint(Particle *p1, Particle *p2) { constraints.push_back(Constraint(p1, p2)); }
+	void SetConstraint(Particle *p1, Particle *p2) { constraints.push_back(Constraint(p1, p2, (int)constraints.size())); }
+
+	// methods to get the tile of a particle, and to put tiles to sleep or wake them up
+	int GetTileIndex(int x, int y) { return (x / TILESIZE) + (y / TILESIZE) * tilesWidth; }
+	void SleepTile(int tx, int ty);
+	void WakeTile(int tx, int ty);
+	void WakeParticle(Particle *p);
+
+	// updates the energy of the tiles and puts the resting tiles to sleep
+	void UpdateSleeping();
+
+	// builds the coarse grids, and solves them while prolonging their corrections to the finer grid
+	void BuildHierarchy();
+	void SolveHierarchy();
+
+	// iterates over the constraints and satisfies them, until the violation is within the tolerance
+	// the kernel is compiled for every combination of tearing or not, and of having particles that can't move or not,
+	// so the features the cloth doesn't use cost nothing in the inner loop, and the solve picks the kernel once per update
+	template<bool Tearable, bool Checked> void SolveConstraintsKernel();
+	void SolveConstraints();
+
+	// the wind and drawing kernels, compiled with and without the checks for torn triangles
+	template<bool Torn> void AddWindForceKernel(const V wind);
+	template<bool AllTriangles> void BuildDrawArraysKernel();
+
+	// counts the pinned particles and checks for broken particles, after the particles were pinned, reset or loaded
+	void CountFeatures();
+
+	// builds and factors the projective dynamics system, and solves the constraints with it
+	void FactorProjective();
+	void SolveProjective();
+
+	// builds the tethers from the pinned particles along the constraints, and pulls the particles back within their range
+	void BuildTethers();
+	void SatisfyTethers();
+
+	// updates the particle positions and tracks the kinetic energy per tile
+	void IntegrateParticles();
+
+	// multiplies a vector with the linearized spring stiffness, and updates the cloth with implicit euler
+	void ApplyStiffness(std::vector<V> &in, std::vector<V> &out);
+	void UpdateImplicit();
+
+	// extrapolates the particle positions after a constraint iteration, omega is the chebyshev weight of the iteration
+	// also estimates the spectral radius from the plain iterations if needed
+	void AccelerateIteration(int iter, float &omega);
+
+	// returns true once the iterations can stop, after at least minIter finished iterations with the residual within the tolerance
+	bool Converged(int finishedIter) { return finishedIter >= minIter && rmsResidual < tolerance; }
 
 	// set the pattern of the cloth
 	Vec3 ClothPattern(int x, int y);
 
+	// bakes the pattern into the colors of the quads
+	void BakePattern();
+
 	// calculates the normal of a triangle, defined by 3 particles
-	Vec3 CalcTriangleNormal(Particle *p1, Particle *p2, Particle *p3);
+	V CalcTriangleNormal(Particle *p1, Particle *p2, Particle *p3);
+
+	// calculates the normals of the two triangles of a quad
+	void UpdateQuadNormals(int x, int y);
 
-	// color and draw a triangle
-	void DrawTriangle(Particle *p1, Particle *p2, Particle *p3, const Vec3 color);
+	// adds a triangle with the smooth normals of its particles to the draw arrays, and its color if the colors are rebuilt
+	void AddTriangle(Particle *p1, Particle *p2, Particle *p3, const Vec3 &color);
 
-	// method to simulate forces on the triangle
-	void AddForcesToTriangle(Particle *p1, Particle *p2, Particle *p3, const Vec3 direction);
+	// method to simulate the aerodynamic forces on the triangle, based on the velocity of the triangle relative to the wind
+	void AddForcesToTriangle(Particle *p1, Particle *p2, Particle *p3, const V normal, const V wind);
 
 public:
-	// constructor
-	Cloth(Vec3 worldPos, float width, float height, int particlesWidth, int particlesHeight, 
+	// constructor, the seed picks the random streams of the cloth
+	BasicCloth(Vec3 worldPos, float width, float height, int particlesWidth, int particlesHeight, 
 		Pattern pattern = Pattern::Vertical, Vec3 color1 = Vec3(0.6f, 0.2f, 0.2f), Vec3 color2 = Vec3(1.0f, 1.0f, 1.0f), 
-		int constIter = 15, float stretchFactor = 1.0f)
+		int constIter = 15, float stretchFactor = 1.0f, unsigned long long seed = 1)
 		: worldPos(worldPos), width(width), height(height), particlesWidth(particlesWidth), particlesHeight(particlesHeight), 
 		pattern(pattern), color1(color1), color2(color2), constIter(constIter)
 	{
-		// set the initial tearing state of a cloth to false
+		// set the initial tearing state of a cloth to false, and don't show the tears
 		tearable = false;
+		showTears = false;
+		torn = false;
+		pinnedCount = 0;
+
+		// the colors are built and uploaded when the cloth is first drawn, without a texture
+		imageWidth = imageHeight = 0;
+		colorsDirty = true;
+		colorsChanged = false;
+		colorBuffer = uvBuffer = 0;
+		texture = 0;
+
+		// iterate the full amount of times until a tolerance is set
+		tolerance = 0.0f;
+		minIter = constIter;
+		maxResidual = rmsResidual = 0.0f;
+		lastIter = 0;
+
+		// the iterations aren't accelerated by default
+		chebyshev = false;
+		autoSpectralRadius = true;
+		spectralRadius = 0.9f;
+		firstResidual = 0.0f;
+		chebyshevDelay = 3;
+
+		// the constraints are iterated by default
+		projective = false;
+		factorDirty = true;
+		pdStiffness = 1000.0f;
+
+		// the integration is explicit by default
+		implicit = false;
+		implicitScale = 4.0f;
+		implicitStiffness = 50.0f;
+		cgTolerance = 1e-4f;
+		cgIter = 100;
+
+		// the tethers aren't used by default
+		tethers = false;
+		tethersDirty = true;
+		tetherSlack = 1.0f;
+
+		// the hierarchy isn't used by default
+		multigrid = false;
+		multigridIter = 2;
+
+		// set the default aerodynamic coefficients and damping
+		drag = 1.0f;
+		lift = 0.5f;
+		damping = DAMPING;
+
+		// the random numbers only depend on the seed, so cloths built on different threads don't share a global randomizer
+		step = 0;
+		SetSeed(seed);
 
 		// the stretch depends on the stretchFactor and the amount of particles in the cloth
 		float particleAmount = ((float)particlesWidth * (float)particlesHeight) / 1000;
@@ -56,13 +278,22 @@ public:
 		// resize the vector to house all the particles
 		particles.resize(particlesWidth*particlesHeight);
 
-		// initialize all the particles in the grid
+		// initialize all the particles in the grid, the texture is stretched over the grid
+		gridUVs.resize(2 * particlesWidth * particlesHeight);
 		for (int x = 0; x < particlesWidth; x++)
 			for (int y = 0; y < particlesHeight; y++)
 			{
 				Vec3 pos = Vec3(width * (x / (float)particlesWidth), -height * (y / (float)particlesHeight), 0);
-				particles[x + y * particlesWidth] = Particle(pos + worldPos);
+				particles[x + y * particlesWidth] = Particle(V(pos + worldPos));
+				gridUVs[2 * (x + y * particlesWidth)] = x / (float)(particlesWidth - 1);
+				gridUVs[2 * (x + y * particlesWidth) + 1] = y / (float)(particlesHeight - 1);
 			}
+
+		// divide the particles into tiles, which start out awake
+		tilesWidth = (particlesWidth + TILESIZE - 1) / TILESIZE;
+		tilesHeight = (particlesHeight + TILESIZE - 1) / TILESIZE;
+		tiles.resize(tilesWidth * tilesHeight);
+		WakeAll();
 		
 		// for each particle, connect it to its neighbors
 		for (int x = 0; x < particlesWidth; x++)
@@ -84,23 +315,66 @@ public:
 				if (x < particlesWidth - 2 && y < particlesHeight - 2) SetConstraint(GetParticle(x + 2, y), GetParticle(x, y + 2));
 			}
 		
+		// build the coarse grids from the initial positions
+		BuildHierarchy();
+
 		// Fix the top 2 corners so that the cloth hangs
 		SwitchCorner(1); SwitchCorner(2);
+
+		// nothing collided yet, and the normals are needed before the first update
+		collisionSlot.assign(particles.size(), -1);
+		UpdateNormals();
+		BakePattern();
+	}
+
+	// destructor, frees the buffers on the gpu
+	~BasicCloth()
+	{
+		if (colorBuffer) glDeleteBuffers(1, &colorBuffer);
+		if (uvBuffer) glDeleteBuffers(1, &uvBuffer);
 	}
 
 	// draw the triangles in a smooth shaded format
 	// four particles in a grid are connected via 2 triangles, diagonal from bottom left to top right
 	void DrawShaded();
 
+	// the two halves of DrawShaded, building the draw arrays doesn't use OpenGL so it can run on any thread
+	void BuildDrawArrays();
+	void DrawArrays();
+
 	// updates the cloth by satisfying the constraints and updating the particle positions
+	// the normals have to be updated afterwards, before the next update or drawing the cloth
 	void Update();
 
+	// calculates the normals of all the triangles, only reads the particle positions
+	// so it can run at the same time as resolving the collisions
+	void UpdateNormals();
+
 	// adds a force to all the particles in the cloth
 	void AddForce(const Vec3 direction);
 
 	// add the wind force to all the particles, 
-	// seperately added since the final force is proportional to the triangle area from the wind direction
-	void AddWindForce(const Vec3 direction);
+	// seperately added since the final force depends on the triangle area and its velocity relative to the wind
+	// the wind is given as a displacement per timestep, a zero wind still applies air resistance to the moving cloth
+	void AddWindForce(const Vec3 wind);
+
+	// seeds the random numbers of the cloth, the same seed and input always give the same simulation
+	// the random pattern depends on the seed, so it is baked again
+	void SetSeed(unsigned long long s) { seed = s; tearKey = Random::Hash(seed, step); if (pattern == Pattern::Random) BakePattern(); }
+	unsigned long long GetSeed() { return seed; }
+
+	// sets the fraction of the velocity that is lost every timestep
+	void SetDamping(float d) { damping = d; }
+
+	// uses an image with 4 bytes per pixel as the pattern, the image is stretched over the cloth
+	void SetPatternImage(const unsigned char *pixels, int w, int h);
+
+	// draws the cloth with a texture instead of the pattern, zero draws the pattern again
+	void SetTexture(GLuint id) { texture = id; }
+	bool HasTexture() { return texture != 0; }
+
+	// sets the drag and lift coefficients of the cloth
+	void SetAerodynamics(float dragCoefficient, float liftCoefficient) { drag = dragCoefficient; lift = liftCoefficient; }
 
 	// switches a specific corner state
 	void SwitchCorner(int corner);
@@ -108,11 +382,95 @@ public:
 	// reset the position of the cloth and cloth state
 	void ResetCloth();
 
-	// resolves collision with a sphere
+	// returns the resolution of the cloth
+	int GetParticlesWidth() { return particlesWidth; }
+	int GetParticlesHeight() { return particlesHeight; }
+
+	// copies the positions of all the particles into a buffer of 3 floats or doubles per particle
+	void CopyPositions(float *out);
+	void CopyPositions(double *out);
+
+	// copies whether every particle is part of a broken constraint into a buffer of 1 byte per particle
+	void CopyBroken(unsigned char *out);
+
+	// saves the state of the particles and the remaining constraints to a binary file, optionally compressed
+	// returns false if the file couldn't be written
+	bool SaveState(const char* fileName, bool compress = true);
+
+	// restores a state saved by a cloth with the same resolution, returns false if the file can't be used
+	bool LoadState(const char* fileName);
+
+	// resolves collision with a sphere, waking up the particles it touches
+	// the new positions are kept aside until ApplyCollisions, so the positions can be read by other threads in the meantime
 	void SphereCollision(const Vec3 center, const float radius);
 
+	// moves the particles that collided since the last call, and updates the normals of the triangles around them
+	void ApplyCollisions();
+
+	// wakes up all the tiles of the cloth
+	void WakeAll();
+
+	// sets the constraint tolerance and the minimum and maximum amount of solver iterations
+	void SetTolerance(float tol, int minIterations, int maxIterations) { tolerance = tol; minIter = minIterations; constIter = maxIterations; }
+
+	// returns the largest and root mean square relative constraint violation, measured during the last iteration of the last update
+	float GetMaxResidual() { return maxResidual; }
+	float GetRmsResidual() { return rmsResidual; }
+
+	// returns the amount of iterations done during the last update
+	int GetIterations() { return lastIter; }
+
+	// returns the kinetic energy of the cloth, the largest stretch of a constraint relative to its rest length,
+	// and the amount of constraints that tore since the cloth was built or reset
+	float GetKineticEnergy();
+	float GetMaxStretch();
+	int GetTearCount() { return (int)backupConstraints.size(); }
+
+	// enables chebyshev acceleration of the constraint iterations, the spectral radius is estimated automatically if it is zero
+	void SetChebyshev(bool enable, float radius = 0.0f, int delay = 3)
+	{
+		chebyshev = enable;
+		autoSpectralRadius = (radius <= 0.0f);
+		spectralRadius = autoSpectralRadius ? 0.9f : radius;
+		chebyshevDelay = std::max(delay, 2);
+	}
+	void SwitchChebyshev() { chebyshev = !chebyshev; }
+
+	// returns the (estimated) spectral radius used for the chebyshev acceleration
+	float GetSpectralRadius() { return spectralRadius; }
+
+	// enables solving the coarse grids before the cloth itself, with a certain amount of iterations per grid
+	void SetMultigrid(bool enable, int iterations = 2) { multigrid = enable; multigridIter = iterations; }
+	void SwitchMultigrid() { multigrid = !multigrid; }
+
+	// enables the projective dynamics solver, the stiffness is the weight of the constraints relative to the particle inertia
+	void SetProjective(bool enable, float stiffness = 1000.0f) { projective = enable; pdStiffness = stiffness; factorDirty = true; }
+	void SwitchProjective() { projective = !projective; factorDirty = true; }
+
+	// enables the tethers, slack is the factor with which the particles may exceed the geodesic distance to the pins
+	void SetTethers(bool enable, float slack = 1.0f) { tethers = enable; tetherSlack = slack; tethersDirty = true; }
+	void SwitchTethers() { tethers = !tethers; tethersDirty = true; }
+
+	// enables implicit euler integration, with a timestep that is a multiple of the basic timestep and a certain spring stiffness
+	// the conjugate gradient solve stops once its relative residual is below the tolerance
+	void SetImplicit(bool enable, float timestepScale = 4.0f, float stiffness = 50.0f, float cgTol = 1e-4f, int cgIterations = 100)
+	{
+		implicit = enable;
+		implicitScale = timestepScale;
+		implicitStiffness = stiffness;
+		cgTolerance = cgTol;
+		cgIter = cgIterations;
+	}
+
+	// returns true if every tile of the cloth is sleeping
+	bool IsSleeping() { return awakeTiles == 0; }
+
 	// show the tears in the cloth or not
-	void SwitchShowTears() { showTears = !showTears; }
+	void SwitchShowTears() { showTears = !showTears; colorsDirty = true; }
 	// make the cloth tearable or not
-	void SwitchTearable() { tearable = !tearable; }
-};
\ No newline at end of file
+	void SetTearable(bool enable) { tearable = enable; WakeAll(); }
+	void SwitchTearable() { tearable = !tearable; WakeAll(); }
+};
+
+// the cloths of a scene are simulated in float, offline runs can use double
+typedef BasicCloth<Vec3> Cloth;
\ No newline at end of file
@@ -1,47 +1,88 @@
-/* simple constraint class for the cloth simulation */
-class Constraint
+/* simple constraint class for the cloth simulation, templated on the vector type of the particles */
+template<typename V>
+class BasicConstraint
 {
 private:
-	float restDist; // the rest length between two particles
+	typedef typename V::Scalar T;
+
+	T restDist;     // the rest length between two particles
+	int id;         // the index of the constraint when the cloth was built, which doesn't change when other constraints tear
 
 public:
-	Particle *p1, *p2; // two connected particles
+	BasicParticle<V> *p1, *p2; // two connected particles
 
 	// constructor
-	Constraint(Particle *p1, Particle *p2) : p1(p1), p2(p2)
+	BasicConstraint(BasicParticle<V> *p1, BasicParticle<V> *p2, int id = 0) : id(id), p1(p1), p2(p2)
 	{
-		Vec3 spring = p1->GetPos() - p2->GetPos();
+		V spring = p1->GetPos() - p2->GetPos();
 		restDist = spring.Length();
 	}
 
-	// satisfy the constraint between two particles
+	// returns the rest length of the constraint, and the index of the constraint when the cloth was built
+	T GetRestDist() { return restDist; }
+	int GetId() { return id; }
+
+	// flags the particles as part of a broken constraint
+	// which particle is flagged follows from hashing the key of the current step with the id, so it is reproducible
+	void Break(unsigned long long tearKey)
+	{
+		// randomly break one of the particles
+		bool randTear = (Random::Hash(tearKey, id) & 1) != 0;
+		if (randTear) { p1->SetToBroken(); }
+		else { p2->SetToBroken(); }
+	}
+
+	// satisfy the constraint between two particles, error returns the relative violation before the correction
 	// if the constraint stretches too much, it should break
-	bool SatisfyConstraint(bool tearable, float stretchFactor)
+	// the tearing and the check whether the particles can move are compiled out if the cloth doesn't need them
+	template<bool Tearable, bool Checked>
+	bool SatisfyConstraint(T stretchFactor, T &error, unsigned long long tearKey)
 	{
 		// get the spring and the current length of the spring
-		Vec3 spring = p2->GetPos() - p1->GetPos();
-		float currDist = spring.Length(); 
+		V spring = p2->GetPos() - p1->GetPos();
+		T currDist = spring.Length(); 
+		error = std::abs(currDist - restDist) / restDist;
 
 		// check if the constraint should break
 		// if so, flag the particles as part of a broken constraint
-		if (tearable && currDist > restDist * stretchFactor)
+		if (Tearable && currDist > restDist * stretchFactor)
 		{
-			// randomly break one of the particles
-			bool randTear = rand() % 2;		
-			if (randTear) { p1->SetToBroken(); }
-			else { p2->SetToBroken(); }
-
+			Break(tearKey);
 			return true;
 		}
 
 		// calculate the correction to move back to the rest length
-		Vec3 correction = (spring * (1 - restDist / currDist)) * 0.5;
+		V correction = (spring * (1 - restDist / currDist)) * T(0.5);
 
 		// apply the correction to both particles
-		p1->OffsetPos(correction); 
-		p2->OffsetPos(-correction);
+		if (Checked)
+		{
+			p1->OffsetPos(correction);
+			p2->OffsetPos(-correction);
+		}
+		else
+		{
+			p1->MovePos(correction);
+			p2->MovePos(-correction);
+		}
 
 		// the constraint isn't broken so return false
 		return false;
 	}
-};
\ No newline at end of file
+
+	// only pull the particles back to the rest length if they are too far apart, the constraint never breaks
+	void SatisfyStretch()
+	{
+		V spring = p2->GetPos() - p1->GetPos();
+		T currDist = spring.Length();
+		if (currDist <= restDist)
+			return;
+
+		V correction = (spring * (1 - restDist / currDist)) * T(0.5);
+		p1->OffsetPos(correction);
+		p2->OffsetPos(-correction);
+	}
+};
+
+// the cloth is simulated in float
+typedef BasicConstraint<Vec3> Constraint;
\ No newline at end of file
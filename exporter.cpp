@@ -0,0 +1,222 @@
+#include "precomp.h" // only include this header in source files
+
+// the maximum amount of frames waiting to be written
+#define MAXQUEUEDMESHES 4
+
+/* Private methods */
+
+// writes the queued frames until the exporter is stopped
+void Exporter::WriteFrames()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while (true)
+	{
+		// wait for a frame, and stop once all the frames are written
+		queueChanged.wait(guard, [this] { return stopping || !queue.empty(); });
+		if (queue.empty())
+			return;
+
+		// write the frame without holding the lock, so the simulation can keep queueing frames
+		MeshFrame frame;
+		std::swap(frame, queue.front());
+		queue.pop_front();
+		guard.unlock();
+
+		char fileName[256];
+		snprintf(fileName, sizeof(fileName), "%s%04d.%s", prefix.c_str(), frame.number, format == MeshFormat::Obj ? "obj" : "ply");
+		BuildMesh(frame);
+		bool written = (format == MeshFormat::Obj) ? WriteObj(frame, fileName) : WritePly(frame, fileName);
+		if (!written)
+			std::cout << "could not write mesh " << fileName << std::endl;
+
+		// recycle the buffers
+		guard.lock();
+		freeFrames.push_back(MeshFrame());
+		std::swap(freeFrames.back(), frame);
+	}
+}
+
+// finds the triangles that aren't torn and the smooth normals of a frame
+void Exporter::BuildMesh(const MeshFrame &frame)
+{
+	const float *pos = &frame.positions[0];
+	const unsigned char *broken = &frame.broken[0];
+	normals.assign(frame.positions.size(), 0.0f);
+	triangles.clear();
+
+	for (int x = 0; x < width - 1; x++)
+		for (int y = 0; y < height - 1; y++)
+		{
+			unsigned int p1 = x + y * width, p2 = x + (y + 1) * width, p3 = x + 1 + y * width, p4 = x + 1 + (y + 1) * width;
+			unsigned int corners[2][3] = { { p3, p1, p2 }, { p4, p3, p2 } };
+			for (int t = 0; t < 2; t++)
+			{
+				unsigned int *c = corners[t];
+
+				// every triangle adds its unit normal to the normals, like when the cloth is drawn
+				Vec3 v1 = Vec3(pos[3 * c[0]], pos[3 * c[0] + 1], pos[3 * c[0] + 2]);
+				Vec3 v2 = Vec3(pos[3 * c[1]], pos[3 * c[1] + 1], pos[3 * c[1] + 2]);
+				Vec3 v3 = Vec3(pos[3 * c[2]], pos[3 * c[2] + 1], pos[3 * c[2] + 2]);
+				Vec3 normal = (v2 - v1).Cross(v3 - v1);
+				float area = normal.Length();
+				if (area > 0.0f)
+					normal = normal / area;
+				for (int k = 0; k < 3; k++)
+					for (int i = 0; i < 3; i++)
+						normals[3 * c[k] + i] += normal.f[i];
+
+				// but only triangles that aren't completely torn are exported
+				if (!broken[c[0]] || !broken[c[1]] || !broken[c[2]])
+				{
+					triangles.push_back(c[0]);
+					triangles.push_back(c[1]);
+					triangles.push_back(c[2]);
+				}
+			}
+		}
+
+	// normalize the normals
+	for (size_t i = 0; i < normals.size(); i += 3)
+	{
+		float length = sqrtf(normals[i] * normals[i] + normals[i + 1] * normals[i + 1] + normals[i + 2] * normals[i + 2]);
+		if (length > 0.0f)
+		{
+			normals[i] /= length;
+			normals[i + 1] /= length;
+			normals[i + 2] /= length;
+		}
+	}
+}
+
+// writes a frame as a wavefront obj file, returns false if the file couldn't be written
+bool Exporter::WriteObj(const MeshFrame &frame, const char* fileName)
+{
+	FILE *file = fopen(fileName, "w");
+	if (!file)
+		return false;
+
+	// the positions, the texture coordinates follow from the grid
+	fprintf(file, "# cloth frame %d\n", frame.number);
+	for (size_t i = 0; i < frame.positions.size(); i += 3)
+		fprintf(file, "v %f %f %f\n", frame.positions[i], frame.positions[i + 1], frame.positions[i + 2]);
+	for (size_t i = 0; i < normals.size(); i += 3)
+		fprintf(file, "vn %f %f %f\n", normals[i], normals[i + 1], normals[i + 2]);
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			fprintf(file, "vt %f %f\n", x / (float)(width - 1), y / (float)(height - 1));
+
+	// the triangles, obj indices start at one
+	for (size_t t = 0; t < triangles.size(); t += 3)
+		fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n",
+			triangles[t] + 1, triangles[t] + 1, triangles[t] + 1,
+			triangles[t + 1] + 1, triangles[t + 1] + 1, triangles[t + 1] + 1,
+			triangles[t + 2] + 1, triangles[t + 2] + 1, triangles[t + 2] + 1);
+
+	bool written = !ferror(file);
+	return (fclose(file) == 0) && written;
+}
+
+// writes a frame as a binary ply file, returns false if the file couldn't be written
+bool Exporter::WritePly(const MeshFrame &frame, const char* fileName)
+{
+	FILE *file = fopen(fileName, "wb");
+	if (!file)
+		return false;
+
+	int vertexCount = width * height, faceCount = (int)triangles.size() / 3;
+	fprintf(file, "ply\nformat binary_little_endian 1.0\ncomment cloth frame %d\n", frame.number);
+	fprintf(file, "element vertex %d\nproperty float x\nproperty float y\nproperty float z\n", vertexCount);
+	fprintf(file, "property float nx\nproperty float ny\nproperty float nz\nproperty float s\nproperty float t\n");
+	fprintf(file, "element face %d\nproperty list uchar uint vertex_indices\nend_header\n", faceCount);
+
+	// the vertices, interleaved as the header describes them
+	std::vector<float> vertices(8 * vertexCount);
+	for (int i = 0; i < vertexCount; i++)
+	{
+		float *v = &vertices[8 * i];
+		v[0] = frame.positions[3 * i];
+		v[1] = frame.positions[3 * i + 1];
+		v[2] = frame.positions[3 * i + 2];
+		v[3] = normals[3 * i];
+		v[4] = normals[3 * i + 1];
+		v[5] = normals[3 * i + 2];
+		v[6] = (i % width) / (float)(width - 1);
+		v[7] = (i / width) / (float)(height - 1);
+	}
+	fwrite(&vertices[0], sizeof(float), vertices.size(), file);
+
+	// the triangles, every face starts with its amount of corners
+	std::vector<unsigned char> faces(faceCount * (1 + 3 * sizeof(unsigned int)));
+	unsigned char *f = faces.empty() ? NULL : &faces[0];
+	for (int t = 0; t < faceCount; t++)
+	{
+		*f++ = 3;
+		memcpy(f, &triangles[3 * t], 3 * sizeof(unsigned int));
+		f += 3 * sizeof(unsigned int);
+	}
+	if (!faces.empty())
+		fwrite(&faces[0], 1, faces.size(), file);
+
+	bool written = !ferror(file);
+	return (fclose(file) == 0) && written;
+}
+
+/* Public methods */
+
+// constructor, starts exporting a cloth to files named prefix0000.obj, prefix0001.obj and so on
+Exporter::Exporter(const char* prefix, Cloth &cloth, MeshFormat format)
+	: prefix(prefix), format(format), width(cloth.GetParticlesWidth()), height(cloth.GetParticlesHeight()),
+	frameCount(0), droppedFrames(0), stopping(false)
+{
+	worker = std::thread(&Exporter::WriteFrames, this);
+}
+
+// destructor, writes the remaining frames
+Exporter::~Exporter()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	queueChanged.notify_all();
+	worker.join();
+
+	if (droppedFrames > 0)
+		std::cout << "skipped " << droppedFrames << " meshes because the export was falling behind" << std::endl;
+}
+
+// queues the current state of the cloth, the frame is skipped instead of waiting if the writer is falling behind
+void Exporter::ExportFrame(Cloth &cloth)
+{
+	// get a free frame, or skip this frame if too many frames are queued
+	MeshFrame frame;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (queue.size() >= MAXQUEUEDMESHES)
+		{
+			droppedFrames++;
+			frameCount++;
+			return;
+		}
+		if (!freeFrames.empty())
+		{
+			std::swap(frame, freeFrames.back());
+			freeFrames.pop_back();
+		}
+	}
+
+	// copy the state outside of the lock
+	frame.number = frameCount++;
+	frame.positions.resize(3 * width * height);
+	frame.broken.resize(width * height);
+	cloth.CopyPositions(&frame.positions[0]);
+	cloth.CopyBroken(&frame.broken[0]);
+
+	// hand the frame to the writer
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queue.push_back(MeshFrame());
+		std::swap(queue.back(), frame);
+	}
+	queueChanged.notify_all();
+}
@@ -0,0 +1,57 @@
+// file formats of the exported meshes
+enum class MeshFormat { Obj, Ply };
+
+/* writes the cloth as a sequence of mesh files on a background thread */
+class Exporter
+{
+private:
+	// a snapshot of the cloth waiting to be written
+	struct MeshFrame
+	{
+		int number;                        // the number of the frame, used in the file name
+		std::vector<float> positions;      // 3 floats per particle
+		std::vector<unsigned char> broken; // 1 if the particle is part of a broken constraint, 0 if not
+	};
+
+	std::string prefix;                  // the file name of every mesh starts with this, followed by the frame number
+	MeshFormat format;                   // the file format of the meshes
+	int width, height;                   // the resolution of the cloth
+	int frameCount, droppedFrames;       // the amount of queued frames and of frames skipped because the queue was full
+
+	// frames waiting to be written, and frames that can be reused
+	std::deque<MeshFrame> queue, freeFrames;
+	std::mutex lock;
+	std::condition_variable queueChanged;
+	bool stopping;
+	std::thread worker;
+
+	// the normals and triangles of the frame that is being written
+	std::vector<float> normals;
+	std::vector<unsigned int> triangles;
+
+	// writes the queued frames until the exporter is stopped
+	void WriteFrames();
+
+	// finds the triangles that aren't torn and the smooth normals of a frame
+	void BuildMesh(const MeshFrame &frame);
+
+	// writes a frame as a wavefront obj or binary ply file, returns false if the file couldn't be written
+	bool WriteObj(const MeshFrame &frame, const char* fileName);
+	bool WritePly(const MeshFrame &frame, const char* fileName);
+
+public:
+	// constructor, starts exporting a cloth to files named prefix0000.obj, prefix0001.obj and so on
+	Exporter(const char* prefix, Cloth &cloth, MeshFormat format = MeshFormat::Obj);
+
+	// destructor, writes the remaining frames
+	~Exporter();
+
+	// returns the file format of the meshes
+	MeshFormat GetFormat() { return format; }
+
+	// returns the amount of frames that were skipped because the writer was falling behind
+	int GetDroppedFrames() { return droppedFrames; }
+
+	// queues the current state of the cloth, the frame is skipped instead of waiting if the writer is falling behind
+	void ExportFrame(Cloth &cloth);
+};
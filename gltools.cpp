@@ -25,22 +25,56 @@ GLuint CreateTexture( uint* pixels, int w, int h )
 	return retVal;
 }
 
+// swaps the red and blue channels of rgba pixels and makes them opaque, 8 or 4 pixels at a time with avx2 or sse2
+void SwizzlePixels( uint* d, size_t count )
+{
+	size_t i = 0;
+#ifdef __AVX2__
+	const __m256i order = _mm256_setr_epi8( 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15 );
+	const __m256i alpha8 = _mm256_set1_epi32( 0xff000000 );
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i p = _mm256_loadu_si256( (const __m256i*)&d[i] );
+		_mm256_storeu_si256( (__m256i*)&d[i], _mm256_or_si256( _mm256_shuffle_epi8( p, order ), alpha8 ) );
+	}
+#endif
+#ifdef USE_SSE2
+	// sse2 has no byte shuffle, so the channels are moved with shifts and masks on 32 bit lanes
+	const __m128i green = _mm_set1_epi32( 0xff00 ), low = _mm_set1_epi32( 0xff ), alpha = _mm_set1_epi32( 0xff000000 );
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i p = _mm_loadu_si128( (const __m128i*)&d[i] );
+		__m128i r = _mm_slli_epi32( _mm_and_si128( p, low ), 16 ), b = _mm_and_si128( _mm_srli_epi32( p, 16 ), low );
+		_mm_storeu_si128( (__m128i*)&d[i], _mm_or_si128( _mm_or_si128( r, b ), _mm_or_si128( _mm_and_si128( p, green ), alpha ) ) );
+	}
+#endif
+	for (; i < count; i++) d[i] = ((d[i] & 255) << 16) + (255 << 24) + ((d[i] >> 16) & 255) + (d[i] & 0xff00);
+}
+
+// loads a texture and hands back the swizzled pixels in the decoded buffer itself, without copying them
+GLuint LoadTexture( const char* fileName, vector<uchar>& pixels, uint& w, uint& h )
+{
+	GLuint retVal = 0;
+	if (LoadPNGFile( fileName, w, h, pixels ))
+	{
+		uint* d = (uint*)pixels.data();
+		SwizzlePixels( d, (size_t)w * h );
+		retVal = CreateTexture( d, w, h );
+	}
+	return retVal;
+}
+
 GLuint LoadTexture( const char* fileName, uint** data = 0 )
 {
 	vector<uchar> image;
 	uint w, h;
-	GLuint retVal = 0;
-	if (LoadPNGFile( fileName, w, h, image )) 
+	GLuint retVal = LoadTexture( fileName, image, w, h );
+	if (retVal && data)
 	{
-		uint* d = (uint*)image.data();
-		for( int i = 0; i < w * h; i++ ) d[i] = ((d[i] & 255) << 16) + (255 << 24) + ((d[i] >> 16) & 255) + (d[i] & 0xff00);
-		retVal = CreateTexture( d, w, h );
-		if (data)
-		{
-			uint* buffer = new uint[w * h];
-			memcpy( buffer, image.data(), w * h * sizeof( uint ) );
-			*data = buffer;
-		}
+		// the caller owns a copy, use the overload above to avoid it
+		uint* buffer = new uint[w * h];
+		memcpy( buffer, image.data(), w * h * sizeof( uint ) );
+		*data = buffer;
 	}
 	return retVal;
 }
@@ -1,60 +1,110 @@
-/* represents a particle with mass */
-class Particle
+/* represents a particle with mass, templated on the vector type so the particle can be simulated in float or double */
+template<typename V>
+class BasicParticle
 {
 private:
+	typedef typename V::Scalar T;
+
 	bool fixed;        // is the particle movable or not
 	bool broken;       // is this particle part of a broken constraint or not
+	bool sleeping;     // is the particle resting, a sleeping particle is treated as unmovable
 
-	float mass;        // particle mass
-	Vec3 acceleration; // current acceleration of the particle
+	T mass;            // particle mass
+	V acceleration;    // current acceleration of the particle
 
-	Vec3 currPos;      // current particle position
-	Vec3 prevPos;      // previous particle position
-	Vec3 nonNormal;    // non-normalized normal (used for shading)
+	V currPos;         // current particle position
+	V prevPos;         // previous particle position
+	V nonNormal;       // non-normalized normal (used for shading)
 
 public:
 	// constructors
-	Particle() {}
-	Particle(Vec3 pos) : fixed(false), broken(false), mass(1), acceleration(Vec3(0, 0, 0)), currPos(pos), prevPos(pos), nonNormal(Vec3(0, 0, 0)) {}
+	BasicParticle() {}
+	BasicParticle(V pos) : fixed(false), broken(false), sleeping(false), mass(1), acceleration(V(0, 0, 0)), currPos(pos), prevPos(pos), nonNormal(V(0, 0, 0)) {}
+
+	// returns the mass of the particle
+	T GetMass() { return mass; }
 
-	// adds a force to the particle
-	void AddForce(Vec3 force) { acceleration += force / mass; }
+	// adds a force to the particle, a sleeping particle ignores it like it ignores being moved
+	// so the forces don't build up while it sleeps and move it all at once when it wakes up
+	void AddForce(V force) { if (!sleeping) acceleration += force / mass; }
 
-	// updates the position of the particle using verlet integration
-	void Update()
+	// updates the position of the particle using verlet integration, losing a fraction of the velocity to damping
+	void Update(T damping)
 	{
-		// return if the particle is unmovable
+		// return if the particle is unmovable, the cloth skips the sleeping particles
 		if (fixed)
 			return;
 
 		// verlet integration
-		Vec3 temp = currPos;
-		currPos = currPos + (currPos - prevPos) * (1.0 - DAMPING) + acceleration * TIMESTEP2;
+		V temp = currPos;
+		currPos = currPos + (currPos - prevPos) * (T(1) - damping) + acceleration * T(TIMESTEP2);
 		prevPos = temp;
 
 		// reset acceleration
-		acceleration = Vec3(0, 0, 0);			
+		acceleration = V(0, 0, 0);			
 	}
 
 	// position functions
-	Vec3& GetPos() { return currPos; }
-	void OffsetPos(const Vec3 v) { if (!fixed) currPos += v; }
+	V& GetPos() { return currPos; }
+	void OffsetPos(const V v) { if (!fixed && !sleeping) currPos += v; }
+	void SetPos(const V pos) { if (!fixed && !sleeping) currPos = pos; }
+	void MovePos(const V v) { currPos += v; } // only for particles that are known to be movable
+	bool IsMovable() { return !fixed && !sleeping; }
+
+	// returns the displacement of the particle during the last timestep
+	V GetVelocity() { return currPos - prevPos; }
+
+	// returns the position of the particle before the last timestep
+	V& GetPrevPos() { return prevPos; }
+
+	// restores a saved state of the particle, the particle starts awake without acceleration
+	void Restore(V pos, V prev, bool isFixed, bool isBroken)
+	{
+		currPos = pos;
+		prevPos = prev;
+		fixed = isFixed;
+		broken = isBroken;
+		sleeping = false;
+		acceleration = V(0, 0, 0);
+	}
+
+	// returns the acceleration accumulated since the last update
+	V& GetAcceleration() { return acceleration; }
+
+	// moves the particle to a new position with a certain displacement per timestep, used by the implicit integrator
+	void SetState(V pos, V velocity)
+	{
+		acceleration = V(0, 0, 0);
+		if (fixed || sleeping)
+			return;
+
+		currPos = pos;
+		prevPos = pos - velocity;
+	}
 
 	// normal functions, normal is not unit length
-	Vec3& GetNormal() { return nonNormal; }
-	void ResetNormal() { nonNormal = Vec3(0, 0, 0); }
-	void AddToNormal(Vec3 normal) { nonNormal += normal.Normalized(); }
+	V& GetNormal() { return nonNormal; }
+	void ResetNormal() { nonNormal = V(0, 0, 0); }
+	void AddToNormal(V normal) { nonNormal += normal.Normalized(); }
 
 	// resets acceleration
-	void ResetAcceleration() { acceleration = Vec3(0, 0, 0); }
+	void ResetAcceleration() { acceleration = V(0, 0, 0); }
 
 	// make the particle movable/unmovable
 	bool GetMoveState() { return fixed; }
 	void MakeMovable() { fixed = false; }
 	void MakeUnmovable() { fixed = true; }
 
+	// put the particle to sleep or wake it up, a sleeping particle loses its velocity
+	void Sleep() { sleeping = true; prevPos = currPos; acceleration = V(0, 0, 0); }
+	void WakeUp() { sleeping = false; }
+	bool IsSleeping() { return sleeping; }
+
 	// flag the particle as being part of a broken constraint or not
 	void SetToFixed() { broken = false; }
 	void SetToBroken() { broken = true; }
 	bool IsBroken() { return broken; }
-};
\ No newline at end of file
+};
+
+// the cloth is simulated in float
+typedef BasicParticle<Vec3> Particle;
\ No newline at end of file
@@ -1,6 +1,16 @@
-#include <vector>
-#include <iostream>
-#include <fstream>
+#include "precomp.h" // only include this header in source files
+
+// memory mapping
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 typedef unsigned char uchar;
 typedef unsigned int uint;
@@ -25,6 +35,46 @@ convert_to_rgba32: optional parameter, true by default.
   works for trusted PNG files. Use LodePNG instead of picoPNG if you need this information.
 return: 0 if success, not 0 if some error occured.
 */
+#ifdef USE_SSE2
+/*
+sse2 versions of the scanline filters, for 3 and 4 byte pixels. up works on 16 bytes at a time in the decoder itself,
+sub, average and paeth on one pixel at a time since every pixel depends on the one before it.
+*/
+template<size_t BW> static inline __m128i loadPixel( const uchar* p ) { int v = 0; memcpy( &v, p, BW ); return _mm_cvtsi32_si128( v ); }
+template<size_t BW> static inline void storePixel( uchar* p, __m128i v ) { int k = _mm_cvtsi128_si32( v ); memcpy( p, &k, BW ); }
+static inline __m128i abs16( __m128i v ) { return _mm_max_epi16( v, _mm_sub_epi16( _mm_setzero_si128(), v ) ); }
+static inline __m128i select16( __m128i mask, __m128i a, __m128i b ) { return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) ); }
+template<size_t BW> static void unFilterPixelsSSE2( uchar* recon, const uchar* scanline, const uchar* precon, uint filterType, size_t length )
+{
+	const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8( 1 );
+	__m128i a = zero, b = zero, c = zero;
+	if (filterType == 1) for (size_t i = 0; i < length; i += BW)
+	{
+		a = _mm_add_epi8( loadPixel<BW>( &scanline[i] ), a );
+		storePixel<BW>( &recon[i], a );
+	}
+	else if (filterType == 3) for (size_t i = 0; i < length; i += BW)
+	{
+		// the average rounded down, avg_epu8 rounds up
+		if (precon) b = loadPixel<BW>( &precon[i] );
+		__m128i avg = _mm_sub_epi8( _mm_avg_epu8( a, b ), _mm_and_si128( _mm_xor_si128( a, b ), one ) );
+		a = _mm_add_epi8( loadPixel<BW>( &scanline[i] ), avg );
+		storePixel<BW>( &recon[i], a );
+	}
+	else for (size_t i = 0; i < length; i += BW)
+	{
+		// paeth on 16 bit lanes, the predictor closest to a + b - c wins, in the order a, b, c on ties
+		if (precon) b = _mm_unpacklo_epi8( loadPixel<BW>( &precon[i] ), zero );
+		__m128i pa = _mm_sub_epi16( b, c ), pb = _mm_sub_epi16( a, c ), pc = _mm_add_epi16( pa, pb );
+		pa = abs16( pa ); pb = abs16( pb ); pc = abs16( pc );
+		__m128i smallest = _mm_min_epi16( pc, _mm_min_epi16( pa, pb ) );
+		__m128i nearest = select16( _mm_cmpeq_epi16( smallest, pa ), a, select16( _mm_cmpeq_epi16( smallest, pb ), b, c ) );
+		a = _mm_add_epi8( _mm_unpacklo_epi8( loadPixel<BW>( &scanline[i] ), zero ), nearest );
+		storePixel<BW>( &recon[i], _mm_packus_epi16( a, a ) );
+		c = b;
+	}
+}
+#endif
 int decodePNG( vector<uchar>& out_image, uint& image_width, uint& image_height, const uchar* in_png, size_t in_size, bool convert_to_rgba32 = true )
 {
 	static const uint LENBASE[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
@@ -211,6 +261,30 @@ int decodePNG( vector<uchar>& out_image, uint& image_width, uint& image_height,
 		};
 		int decompress( vector<uchar>& out, const vector<uchar>& in )
 		{
+#ifdef USE_ZLIB
+			// inflate with zlib, out is sized for all the scanlines so a valid stream is inflated by the first call
+			// a stream with more data than that grows the buffer, like the inflater of picoPNG does
+			if (in.size() < 2) { return 53; }
+			z_stream stream;
+			memset( &stream, 0, sizeof( stream ) );
+			if (inflateInit( &stream ) != Z_OK) { return 83; }
+			if (out.empty()) out.resize( 1024 );
+			stream.next_in = (Bytef*)&in[0]; stream.avail_in = (uInt)in.size();
+			stream.next_out = &out[0]; stream.avail_out = (uInt)out.size();
+			int result = inflate( &stream, Z_FINISH );
+			while ((result == Z_OK || result == Z_BUF_ERROR) && stream.avail_out == 0)
+			{
+				size_t written = stream.total_out;
+				out.resize( written * 2 );
+				stream.next_out = &out[written]; stream.avail_out = (uInt)(out.size() - written);
+				result = inflate( &stream, Z_FINISH );
+			}
+			size_t written = stream.total_out;
+			inflateEnd( &stream );
+			if (result != Z_STREAM_END) { return (result == Z_BUF_ERROR) ? 10 : 52; }
+			out.resize( written );
+			return 0;
+#else
 			Inflator inflator;
 			if (in.size() < 2) { return 53; }
 			if ((in[0] * 256 + in[1]) % 31 != 0) { return 24; }
@@ -219,6 +293,7 @@ int decodePNG( vector<uchar>& out_image, uint& image_width, uint& image_height,
 			if (FDICT != 0) { return 26; }
 			inflator.inflate( out, in, 2 );
 			return inflator.error;
+#endif
 		}
 	};
 	struct PNG
@@ -294,9 +369,19 @@ int decodePNG( vector<uchar>& out_image, uint& image_width, uint& image_height,
 				pos += 4;
 			}
 			uint bpp = getBpp( info );
-			std::vector<uchar> scanlines( ((info.width * (info.height * bpp + 7)) / 8) + info.height );
+
+			// the size of the filtered scanlines, every scanline starts with its filter type and is padded to whole bytes,
+			// an interlaced image has separate scanlines for each of its 7 passes
+			size_t passw[7] = { (info.width + 7) / 8, (info.width + 3) / 8, (info.width + 3) / 4, (info.width + 1) / 4, (info.width + 1) / 2, (info.width + 0) / 2, (info.width + 0) / 1 };
+			size_t passh[7] = { (info.height + 7) / 8, (info.height + 7) / 8, (info.height + 3) / 8, (info.height + 3) / 4, (info.height + 1) / 4, (info.height + 1) / 2, (info.height + 0) / 2 };
+			size_t passstart[8] = { 0 };
+			for (int i = 0; i < 7; i++) passstart[i + 1] = passstart[i] + passh[i] * ((passw[i] ? 1 : 0) + (passw[i] * bpp + 7) / 8);
+			size_t scanlinesize = (info.interlaceMethod == 0) ? info.height * (1 + ((size_t)info.width * bpp + 7) / 8) : passstart[7];
+
+			std::vector<uchar> scanlines( scanlinesize );
 			Zlib zlib;
 			error = zlib.decompress( scanlines, idat ); if (error) return;
+			if (scanlines.size() < scanlinesize) { error = 91; return; } // the stream ends before the last scanline
 			size_t bytewidth = (bpp + 7) / 8, outlength = (info.height * info.width * bpp + 7) / 8;
 			out.resize( outlength );
 			uchar* out_ = outlength ? &out[0] : 0;
@@ -313,24 +398,22 @@ int decodePNG( vector<uchar>& out_image, uint& image_width, uint& image_height,
 					}
 				else
 				{
-					std::vector<uchar> templine( (info.width * bpp + 7) >> 3 );
+					// the filters work on the packed scanlines, so the previous scanline is kept packed as well
+					std::vector<uchar> templine( (info.width * bpp + 7) >> 3 ), prevtemp( templine.size() );
 					for (size_t y = 0, obp = 0; y < info.height; y++)
 					{
 						uint filterType = scanlines[linestart];
-						const uchar* prevline = (y == 0) ? 0 : &out_[(y - 1) * info.width * bytewidth];
+						const uchar* prevline = (y == 0) ? 0 : &prevtemp[0];
 						unFilterScanline( &templine[0], &scanlines[linestart + 1], prevline, bytewidth, filterType, linelength ); if (error) return;
 						for (size_t bp = 0; bp < info.width * bpp;) setBitOfReversedStream( obp, out_, readBitFromReversedStream( bp, &templine[0] ) );
+						templine.swap( prevtemp );
 						linestart += (1 + linelength);
 					}
 				}
 			}
 			else
 			{
-				size_t passw[7] = { (info.width + 7) / 8, (info.width + 3) / 8, (info.width + 3) / 4, (info.width + 1) / 4, (info.width + 1) / 2, (info.width + 0) / 2, (info.width + 0) / 1 };
-				size_t passh[7] = { (info.height + 7) / 8, (info.height + 7) / 8, (info.height + 3) / 8, (info.height + 3) / 4, (info.height + 1) / 4, (info.height + 1) / 2, (info.height + 0) / 2 };
-				size_t passstart[7] = { 0 };
 				size_t pattern[28] = { 0,4,0,2,0,1,0,0,0,4,0,2,0,1,8,8,4,4,2,2,1,8,8,8,4,4,2,2 };
-				for (int i = 0; i < 6; i++) passstart[i + 1] = passstart[i] + passh[i] * ((passw[i] ? 1 : 0) + (passw[i] * bpp + 7) / 8);
 				std::vector<uchar> scanlineo( (info.width * bpp + 7) / 8 ), scanlinen( (info.width * bpp + 7) / 8 );
 				for (int i = 0; i < 7; i++)
 					adam7Pass( &out_[0], &scanlinen[0], &scanlineo[0], &scanlines[passstart[i]], info.width, pattern[i], pattern[i + 7], pattern[i + 14], pattern[i + 21], passw[i], passh[i], bpp );
@@ -355,6 +438,9 @@ int decodePNG( vector<uchar>& out_image, uint& image_width, uint& image_height,
 		}
 		void unFilterScanline( uchar* recon, const uchar* scanline, const uchar* precon, size_t bytewidth, uint filterType, size_t length )
 		{
+#ifdef USE_SSE2
+			if (unFilterScanlineSSE2( recon, scanline, precon, bytewidth, filterType, length )) return;
+#endif
 			switch (filterType)
 			{
 			case 0: for (size_t i = 0; i < length; i++) recon[i] = scanline[i]; break;
@@ -393,6 +479,23 @@ int decodePNG( vector<uchar>& out_image, uint& image_width, uint& image_height,
 			default: error = 36; return;
 			}
 		}
+#ifdef USE_SSE2
+		bool unFilterScanlineSSE2( uchar* recon, const uchar* scanline, const uchar* precon, size_t bytewidth, uint filterType, size_t length )
+		{
+			if (filterType == 2 && precon)
+			{
+				size_t i = 0;
+				for (; i + 16 <= length; i += 16)
+					_mm_storeu_si128( (__m128i*)&recon[i], _mm_add_epi8( _mm_loadu_si128( (const __m128i*)&scanline[i] ), _mm_loadu_si128( (const __m128i*)&precon[i] ) ) );
+				for (; i < length; i++) recon[i] = scanline[i] + precon[i];
+				return true;
+			}
+			if (filterType != 1 && filterType != 3 && filterType != 4) return false;
+			if (bytewidth == 4 && length % 4 == 0) { unFilterPixelsSSE2<4>( recon, scanline, precon, filterType, length ); return true; }
+			if (bytewidth == 3 && length % 3 == 0) { unFilterPixelsSSE2<3>( recon, scanline, precon, filterType, length ); return true; }
+			return false;
+		}
+#endif
 		void adam7Pass( uchar* out, uchar* linen, uchar* lineo, const uchar* in, uint w, size_t passleft, size_t passtop, size_t spacex, size_t spacey, size_t passw, size_t passh, uint bpp )
 		{
 			if (passw == 0) return;
@@ -525,7 +628,47 @@ void loadBinaryFile( vector<uchar>& buffer, const string& filename )
 
 bool LoadPNGFile( const char* fileName, uint& w, uint& h, vector<uchar>& image )
 {
+	// decode straight from the mapped file instead of copying it into a buffer first
+	const uchar* data = 0;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	HANDLE mapping = NULL;
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER fileSize;
+		size = GetFileSizeEx( file, &fileSize ) ? (size_t)fileSize.QuadPart : 0;
+		mapping = (size > 0) ? CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL ) : NULL;
+		if (mapping) data = (const uchar*)MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	}
+#else
+	int file = open( fileName, O_RDONLY );
+	if (file >= 0)
+	{
+		struct stat info;
+		size = (fstat( file, &info ) == 0) ? (size_t)info.st_size : 0;
+		void* mapped = (size > 0) ? mmap( NULL, size, PROT_READ, MAP_PRIVATE, file, 0 ) : MAP_FAILED;
+		if (mapped != MAP_FAILED) data = (const uchar*)mapped;
+	}
+#endif
+
+	// fall back to reading the file if it can't be mapped
 	vector<uchar> buffer;
-	loadBinaryFile( buffer, fileName );
-	return decodePNG( image, w, h, &buffer[0], (uint)buffer.size() ) == 0;
+	if (!data)
+	{
+		loadBinaryFile( buffer, fileName );
+		size = buffer.size();
+	}
+	const uchar* in = data ? data : (buffer.empty() ? 0 : &buffer[0]);
+	bool decoded = in && decodePNG( image, w, h, in, size ) == 0;
+
+#ifdef _WIN32
+	if (data) UnmapViewOfFile( data );
+	if (mapping) CloseHandle( mapping );
+	if (file != INVALID_HANDLE_VALUE) CloseHandle( file );
+#else
+	if (data) munmap( (void*)data, size );
+	if (file >= 0) close( file );
+#endif
+	return decoded;
 }
\ No newline at end of file
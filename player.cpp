@@ -0,0 +1,241 @@
+#include "precomp.h" // only include this header in source files
+
+// memory mapping
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Private methods */
+
+// adds the differences stored in a frame to the quantized positions, returns false if the frame can't be decoded
+bool Player::DecodeFrame(int frame)
+{
+	const TrajectoryFrame *f = (const TrajectoryFrame*)(data + index[frame]);
+	const unsigned char *encoded = (const unsigned char*)(f + 1);
+
+	// decompress the frame if needed, which is only possible if zlib is available
+	if (f->flags & FRAME_COMPRESSED)
+	{
+#ifdef USE_ZLIB
+		unpacked.resize(f->rawSize);
+		uLongf unpackedSize = f->rawSize;
+		if (uncompress(&unpacked[0], &unpackedSize, encoded, f->storedSize) != Z_OK || unpackedSize != f->rawSize)
+			return false;
+		encoded = &unpacked[0];
+#else
+		return false;
+#endif
+	}
+
+	// read the zigzag encoded differences, a key frame starts from zero
+	const unsigned char *end = encoded + f->rawSize;
+	bool key = (f->flags & FRAME_KEY) != 0;
+	for (size_t i = 0; i < quantized.size(); i++)
+	{
+		unsigned int zigzag = 0;
+		for (int shift = 0; encoded < end; shift += 7)
+		{
+			unsigned char byte = *encoded++;
+			zigzag |= (unsigned int)(byte & 0x7f) << shift;
+			if (byte < 0x80)
+				break;
+		}
+		int delta = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+		quantized[i] = (key ? 0 : quantized[i]) + delta;
+	}
+	return true;
+}
+
+// unmaps the file
+void Player::Close()
+{
+	if (!data)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mapping);
+	CloseHandle(fileHandle);
+#else
+	munmap((void*)data, size);
+	close(fileHandle);
+#endif
+	data = NULL;
+}
+
+/* Public methods */
+
+// constructor, maps a recorded trajectory file
+Player::Player(const char* fileName)
+	: data(NULL), size(0), header(NULL), index(NULL), frameCount(0), currentFrame(0), positions(NULL), decodedFrame(-1)
+{
+	// map the whole file in memory
+#ifdef _WIN32
+	fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize))
+	{
+		CloseHandle(fileHandle);
+		return;
+	}
+	size = (size_t)fileSize.QuadPart;
+	mapping = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+	{
+		CloseHandle(fileHandle);
+		return;
+	}
+	data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		CloseHandle(mapping);
+		CloseHandle(fileHandle);
+		return;
+	}
+#else
+	fileHandle = open(fileName, O_RDONLY);
+	if (fileHandle < 0)
+		return;
+	struct stat info;
+	if (fstat(fileHandle, &info) != 0)
+	{
+		close(fileHandle);
+		return;
+	}
+	size = (size_t)info.st_size;
+	void *mapped = (size > 0) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fileHandle, 0) : MAP_FAILED;
+	if (mapped == MAP_FAILED)
+	{
+		close(fileHandle);
+		return;
+	}
+	data = (const unsigned char*)mapped;
+#endif
+
+	// check the header and the footer, and find the frame index
+	if (size < sizeof(TrajectoryHeader) + sizeof(TrajectoryFooter))
+	{
+		Close();
+		return;
+	}
+	header = (const TrajectoryHeader*)data;
+	const TrajectoryFooter *footer = (const TrajectoryFooter*)(data + size - sizeof(TrajectoryFooter));
+	// the index lies between the header and the footer, and the particles form the recorded grid
+	if (memcmp(header->magic, "CLTR", 4) != 0 || header->version != TRAJECTORYVERSION || memcmp(footer->magic, "CLTI", 4) != 0 ||
+		footer->indexOffset < sizeof(TrajectoryHeader) || footer->indexOffset > size - sizeof(TrajectoryFooter) ||
+		(size - sizeof(TrajectoryFooter) - footer->indexOffset) != footer->frameCount * sizeof(unsigned long long) ||
+		(unsigned long long)header->width * header->height != header->particleCount || (header->precision > 0.0f && header->keyInterval == 0))
+	{
+		Close();
+		return;
+	}
+	index = (const unsigned long long*)(data + footer->indexOffset);
+	frameCount = (int)footer->frameCount;
+
+	// every frame should lie between the header and the frame index
+	// an uncompressed frame stores its encoded positions as they are, and raw positions are never compressed
+	for (int i = 0; i < frameCount; i++)
+	{
+		if (index[i] < sizeof(TrajectoryHeader) || index[i] > footer->indexOffset - sizeof(TrajectoryFrame))
+		{
+			Close();
+			return;
+		}
+		const TrajectoryFrame *f = (const TrajectoryFrame*)(data + index[i]);
+		if (f->storedSize > footer->indexOffset - sizeof(TrajectoryFrame) - index[i] ||
+			(!(f->flags & FRAME_COMPRESSED) && f->rawSize != f->storedSize) ||
+			(header->precision <= 0.0f && (f->storedSize != (unsigned long long)header->particleCount * 3 * sizeof(float) || (f->flags & FRAME_COMPRESSED))))
+		{
+			Close();
+			return;
+		}
+	}
+	quantized.resize(3 * header->particleCount);
+	decoded.resize(3 * header->particleCount);
+	normals.resize(3 * header->particleCount);
+
+	// the triangles are laid out the same way as the cloth draws them
+	int w = (int)header->width, h = (int)header->height;
+	for (int x = 0; x < w - 1; x++)
+		for (int y = 0; y < h - 1; y++)
+		{
+			unsigned int p1 = x + y * w, p2 = x + (y + 1) * w, p3 = x + 1 + y * w, p4 = x + 1 + (y + 1) * w;
+			indices.push_back(p3); indices.push_back(p1); indices.push_back(p2);
+			indices.push_back(p4); indices.push_back(p3); indices.push_back(p2);
+		}
+
+	if (frameCount > 0)
+		Seek(0);
+}
+
+// moves to a frame, the frame is clamped to the recording
+void Player::Seek(int frame)
+{
+	if (!data || frameCount == 0)
+		return;
+	currentFrame = std::max(0, std::min(frame, frameCount - 1));
+
+	// raw frames are used straight from the mapped file
+	if (header->precision <= 0.0f)
+	{
+		positions = (const float*)(data + index[currentFrame] + sizeof(TrajectoryFrame));
+		return;
+	}
+
+	// quantized frames are decoded from the last key frame, or from the previous frame when playing forward
+	int start = currentFrame - currentFrame % header->keyInterval;
+	if (decodedFrame >= start && decodedFrame <= currentFrame)
+		start = decodedFrame + 1;
+	for (int i = start; i <= currentFrame; i++)
+		if (!DecodeFrame(i))
+		{
+			decodedFrame = -1;
+			positions = NULL;
+			return;
+		}
+	decodedFrame = currentFrame;
+
+	for (size_t i = 0; i < quantized.size(); i++)
+		decoded[i] = quantized[i] * header->precision;
+	positions = &decoded[0];
+}
+
+// draws the current frame in a smooth shaded format with a single color
+void Player::Draw(const Vec3 color)
+{
+	if (!positions)
+		return;
+
+	// create smooth normals by adding up the normals of the triangles around every vertex
+	std::fill(normals.begin(), normals.end(), 0.0f);
+	for (size_t t = 0; t < indices.size(); t += 3)
+	{
+		const float *v1 = positions + 3 * indices[t], *v2 = positions + 3 * indices[t + 1], *v3 = positions + 3 * indices[t + 2];
+		Vec3 e1 = Vec3(v2[0] - v1[0], v2[1] - v1[1], v2[2] - v1[2]), e2 = Vec3(v3[0] - v1[0], v3[1] - v1[1], v3[2] - v1[2]);
+		Vec3 normal = e1.Cross(e2);
+		for (int k = 0; k < 3; k++)
+			for (int c = 0; c < 3; c++)
+				normals[3 * indices[t + k] + c] += normal.f[c];
+	}
+
+	// draw the positions straight from the frame
+	glColor3f(color.f[0], color.f[1], color.f[2]);
+	glEnable(GL_NORMALIZE);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, positions);
+	glNormalPointer(GL_FLOAT, 0, &normals[0]);
+
+	glDrawElements(GL_TRIANGLES, (unsigned int)indices.size(), GL_UNSIGNED_INT, indices.data());
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisable(GL_NORMALIZE);
+}
@@ -0,0 +1,61 @@
+/* plays back a recorded trajectory file by memory mapping it */
+class Player
+{
+private:
+	// the mapped file
+	const unsigned char *data;
+	size_t size;
+#ifdef _WIN32
+	void *fileHandle, *mapping;
+#else
+	int fileHandle;
+#endif
+
+	// the header and the frame index inside the mapped file
+	const TrajectoryHeader *header;
+	const unsigned long long *index;
+	int frameCount;
+
+	// the current frame and its positions, which point into the mapped file for raw recordings
+	int currentFrame;
+	const float *positions;
+
+	// the last decoded frame of a quantized recording, and buffers for the decoding
+	int decodedFrame;
+	std::vector<int> quantized;
+	std::vector<float> decoded;
+	std::vector<unsigned char> unpacked;
+
+	// the triangles of the cloth and the normals of the current frame
+	std::vector<unsigned int> indices;
+	std::vector<float> normals;
+
+	// adds the differences stored in a frame to the quantized positions, returns false if the frame can't be decoded
+	bool DecodeFrame(int frame);
+
+	// unmaps the file
+	void Close();
+
+public:
+	// constructor, maps a recorded trajectory file
+	Player(const char* fileName);
+
+	// destructor
+	~Player() { Close(); }
+
+	// returns false if the file couldn't be mapped or isn't a valid recording
+	bool IsOpen() { return data != NULL; }
+
+	// returns the amount of frames and the current frame
+	int GetFrameCount() { return frameCount; }
+	int GetFrame() { return currentFrame; }
+
+	// moves to a frame, the frame is clamped to the recording
+	void Seek(int frame);
+
+	// moves a certain amount of frames forward or backward
+	void Step(int frames) { Seek(currentFrame + frames); }
+
+	// draws the current frame in a smooth shaded format with a single color
+	void Draw(const Vec3 color);
+};
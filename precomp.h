@@ -11,27 +11,79 @@
 #define SCRWIDTH 1280                 // the width of the application window
 #define SCRHEIGHT 720                 // the height of the application window
 
-#define DAMPING 0.01                  // the amount of damping on mass spring systems
+#define DAMPING 0.005                 // the default amount of damping on mass spring systems
 #define TIMESTEP 0.5                  // basic timestep
 #define TIMESTEP2 TIMESTEP * TIMESTEP // integrated timestep
 
+#define TILESIZE 8                    // the width and height in particles of a sleeping tile
+#define SLEEPENERGY 2e-5f             // the mean kinetic energy per particle below which a tile is quiet
+#define WAKEENERGY 1e-4f              // the mean kinetic energy per particle of a tile that wakes its sleeping neighbors
+#define SLEEPSTEPS 60                 // the amount of quiet timesteps before a tile falls asleep
+#define WAKEFORCE 1e-3f               // the force on a sleeping particle that wakes its tile
+
+#define STATEVERSION 3                // the version of the binary cloth state files
+#define TRAJECTORYVERSION 1           // the version of the recorded trajectory files
+// #define USE_ZLIB                   // compress the cloth state files and inflate images with zlib, requires linking the zlib library
+
 // enum for cloth patterns
-enum class Pattern { Vertical, Horizontal, Checkerboard, Random};
+enum class Pattern { Vertical, Horizontal, Checkerboard, Random, Image };
 
 // basic includes for OpenGL
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
 
+// compression
+#ifdef USE_ZLIB
+#include "zlib.h"
+#endif
+
+// sse2 and avx2 intrinsics, used by the image decoding and the padded vectors when the target supports them
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 // helpers
 #include <iostream>
 #include <ctime>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <string>
 #include <vector>
+#include <algorithm>
+#include <queue>
+#include <map>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <memory>
 #include "vec3.h"
+#include "vec3a.h"
+#include "random.h"
 #include "camera.h"
 #include "openglhelper.h"
+#include "bandmatrix.h"
 
 // headers
 #include "particle.h"
 #include "constraint.h"
 #include "cloth.h"
-#include "sphere.h"
\ No newline at end of file
+#include "sphere.h"
+#include "scene.h"
+#include "threadpool.h"
+#include "texturecache.h"
+#include "world.h"
+#include "sweep.h"
+#include "recorder.h"
+#include "player.h"
+#include "exporter.h"
\ No newline at end of file
@@ -0,0 +1,37 @@
+/* small random number generator with its own state, so every cloth has a reproducible stream of random numbers */
+class Random
+{
+private:
+	unsigned long long state; // the position in the stream
+
+public:
+	// constructor
+	Random(unsigned long long seed = 1) : state(seed) {}
+
+	// restarts the stream, the same seed always gives the same numbers
+	void Seed(unsigned long long seed) { state = seed; }
+
+	// returns and sets the position in the stream, to save and restore it
+	unsigned long long GetState() { return state; }
+	void SetState(unsigned long long s) { state = s; }
+
+	// returns the next random number, using splitmix64
+	unsigned int Next()
+	{
+		unsigned long long z = (state += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return (unsigned int)((z ^ (z >> 31)) >> 32);
+	}
+
+	// returns true or false with equal chance
+	bool NextBool() { return (Next() & 1) != 0; }
+
+	// returns a random number that only depends on a key and a counter, without any state
+	// so it gives the same number in any order and on any thread
+	static unsigned int Hash(unsigned long long key, unsigned long long counter)
+	{
+		Random random(key ^ (counter * 0xd1b54a32d192ed03ULL));
+		return random.Next();
+	}
+};
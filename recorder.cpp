@@ -0,0 +1,187 @@
+#include "precomp.h" // only include this header in source files
+
+// the maximum amount of frames waiting to be written
+#define MAXQUEUEDFRAMES 8
+
+/* Private methods */
+
+// writes the queued frames until the recorder is stopped or a frame couldn't be written
+void Recorder::WriteFrames()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while (true)
+	{
+		// wait for a frame, and stop once all the frames are written
+		queueChanged.wait(guard, [this] { return stopping || !queue.empty(); });
+		if (queue.empty())
+			return;
+
+		// write the frame without holding the lock, so the simulation can keep queueing frames
+		std::vector<float> positions;
+		positions.swap(queue.front());
+		queue.pop_front();
+		guard.unlock();
+		bool written = WriteFrame(positions);
+		guard.lock();
+
+		// stop writing if the frame failed, the queued frames are dropped so a waiting simulation doesn't wait forever
+		if (!written)
+		{
+			failed = true;
+			queue.clear();
+			queueChanged.notify_all();
+			return;
+		}
+
+		// recycle the buffer and let a waiting simulation continue
+		freeBuffers.push_back(std::vector<float>());
+		freeBuffers.back().swap(positions);
+		queueChanged.notify_all();
+	}
+}
+
+// encodes a frame, quantized and delta encoded against the previous frame, and writes it
+bool Recorder::WriteFrame(std::vector<float> &positions)
+{
+	TrajectoryFrame frame;
+	frame.flags = 0;
+	encoded.clear();
+
+	if (header.precision <= 0.0f)
+	{
+		// raw floats, every frame can be used on its own
+		frame.flags = FRAME_KEY;
+		const unsigned char *bytes = (const unsigned char*)&positions[0];
+		encoded.assign(bytes, bytes + positions.size() * sizeof(float));
+	}
+	else
+	{
+		// quantize the positions, and store the difference with the previous frame unless this is a key frame
+		bool key = (index.size() % header.keyInterval) == 0;
+		frame.flags = key ? FRAME_KEY : 0;
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			int quantized = (int)lrintf(positions[i] / header.precision);
+			int delta = quantized - (key ? 0 : prevQuantized[i]);
+			prevQuantized[i] = quantized;
+
+			// small differences of either sign become small unsigned numbers, stored in as few bytes as possible
+			unsigned int zigzag = ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31);
+			while (zigzag >= 0x80)
+			{
+				encoded.push_back((unsigned char)(zigzag | 0x80));
+				zigzag >>= 7;
+			}
+			encoded.push_back((unsigned char)zigzag);
+		}
+	}
+	frame.rawSize = frame.storedSize = (unsigned int)encoded.size();
+	std::vector<unsigned char> *stored = &encoded;
+
+	// compress the encoded frame if zlib is available
+#ifdef USE_ZLIB
+	if (header.precision > 0.0f)
+	{
+		uLongf packedSize = compressBound((uLong)encoded.size());
+		packed.resize(packedSize);
+		if (compress2(&packed[0], &packedSize, &encoded[0], (uLong)encoded.size(), Z_BEST_SPEED) == Z_OK && packedSize < encoded.size())
+		{
+			frame.flags |= FRAME_COMPRESSED;
+			frame.storedSize = (unsigned int)packedSize;
+			stored = &packed;
+		}
+	}
+#endif
+
+	// write the frame and remember where it starts, a failed stream can't give an offset
+	std::streamoff offset = file.tellp();
+	if (offset < 0)
+		return false;
+	file.write((const char*)&frame, sizeof(frame));
+	file.write((const char*)&(*stored)[0], frame.storedSize);
+	if (!file.good())
+		return false;
+	index.push_back((unsigned long long)offset);
+	return true;
+}
+
+/* Public methods */
+
+// constructor, starts recording a cloth to a file
+Recorder::Recorder(const char* fileName, Cloth &cloth, float precision, int keyInterval)
+	: file(fileName, std::ios::out | std::ios::binary), stopping(false), failed(false)
+{
+	TrajectoryHeader h = { { 'C', 'L', 'T', 'R' }, TRAJECTORYVERSION, (unsigned int)(cloth.GetParticlesWidth() * cloth.GetParticlesHeight()),
+		(unsigned int)cloth.GetParticlesWidth(), (unsigned int)cloth.GetParticlesHeight(), std::max(precision, 0.0f), (unsigned int)std::max(keyInterval, 1) };
+	header = h;
+	prevQuantized.resize(3 * header.particleCount, 0);
+
+	if (file.is_open())
+	{
+		file.write((const char*)&header, sizeof(header));
+		worker = std::thread(&Recorder::WriteFrames, this);
+	}
+}
+
+// destructor, writes the remaining frames and the frame index, unless writing a frame failed
+Recorder::~Recorder()
+{
+	if (!file.is_open())
+		return;
+
+	// let the writer finish the queued frames
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	queueChanged.notify_all();
+	worker.join();
+
+	// a failed stream gets no footer, so it isn't mistaken for a complete recording
+	if (failed)
+	{
+		file.close();
+		return;
+	}
+
+	// write the frame index and the footer
+	TrajectoryFooter footer = { (unsigned long long)file.tellp(), (unsigned int)index.size(), { 'C', 'L', 'T', 'I' } };
+	if (!index.empty())
+		file.write((const char*)&index[0], index.size() * sizeof(unsigned long long));
+	file.write((const char*)&footer, sizeof(footer));
+	file.close();
+}
+
+// queues the current positions of the cloth, waits if the writer is falling behind
+bool Recorder::RecordFrame(Cloth &cloth)
+{
+	if (!file.is_open())
+		return false;
+
+	// get a buffer, recording never drops frames so wait for the writer if too many frames are queued
+	std::vector<float> positions;
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		queueChanged.wait(guard, [this] { return failed || queue.size() < MAXQUEUEDFRAMES; });
+		if (failed)
+			return false;
+		if (!freeBuffers.empty())
+		{
+			positions.swap(freeBuffers.back());
+			freeBuffers.pop_back();
+		}
+	}
+
+	// copy the positions outside of the lock
+	positions.resize(3 * header.particleCount);
+	cloth.CopyPositions(&positions[0]);
+
+	// hand the frame to the writer
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queue.push_back(std::vector<float>());
+		queue.back().swap(positions);
+	}
+	queueChanged.notify_all();
+	return true;
+}
@@ -0,0 +1,73 @@
+/* header of a recorded trajectory file, followed by the frames and a frame index */
+struct TrajectoryHeader
+{
+	char magic[4];              // always "CLTR"
+	unsigned int version;       // the version of the file format
+	unsigned int particleCount; // the amount of particles per frame
+	unsigned int width, height; // the resolution of the recorded cloth
+	float precision;            // the quantization step of the positions, zero if the positions are stored as raw floats
+	unsigned int keyInterval;   // every keyInterval-th frame is stored without delta encoding
+};
+
+/* header of a single recorded frame */
+struct TrajectoryFrame
+{
+	unsigned int rawSize;    // the size of the encoded positions before compression
+	unsigned int storedSize; // the size of the data that follows this header
+	unsigned int flags;      // a combination of the frame flags
+};
+
+/* footer at the end of a recorded trajectory file, the frame index precedes it */
+struct TrajectoryFooter
+{
+	unsigned long long indexOffset; // the offset of the frame index, an array of 64 bit frame offsets
+	unsigned int frameCount;        // the amount of frames in the file
+	char magic[4];                  // always "CLTI"
+};
+
+// flags of a recorded frame
+#define FRAME_KEY 1        // the frame is encoded without the previous frame
+#define FRAME_COMPRESSED 2 // the encoded frame is compressed with zlib
+
+/* streams the particle positions of a cloth to a file on a background thread */
+class Recorder
+{
+private:
+	std::ofstream file;                  // the trajectory file
+	TrajectoryHeader header;             // the header of the file
+	std::vector<unsigned long long> index; // the offset of every written frame
+
+	// frames waiting to be written, and buffers that can be reused
+	std::deque<std::vector<float> > queue, freeBuffers;
+	std::mutex lock;
+	std::condition_variable queueChanged;
+	bool stopping;
+	bool failed; // set once a frame couldn't be written, the rest of the recording is dropped
+	std::thread worker;
+
+	// the quantized positions of the previous frame, and buffers for the encoding
+	std::vector<int> prevQuantized;
+	std::vector<unsigned char> encoded, packed;
+
+	// writes the queued frames until the recorder is stopped
+	void WriteFrames();
+
+	// encodes a frame, quantized and delta encoded against the previous frame, and writes it
+	// returns false if the frame couldn't be written
+	bool WriteFrame(std::vector<float> &positions);
+
+public:
+	// constructor, starts recording a cloth to a file
+	// positions are quantized with the precision and delta encoded, a precision of zero stores them as raw floats
+	Recorder(const char* fileName, Cloth &cloth, float precision = 0.001f, int keyInterval = 60);
+
+	// destructor, writes the remaining frames and the frame index, unless writing a frame failed
+	~Recorder();
+
+	// returns false if the file couldn't be opened
+	bool IsOpen() { return file.is_open(); }
+
+	// queues the current positions of the cloth, waits if the writer is falling behind
+	// returns false if the file couldn't be opened or a previous frame couldn't be written
+	bool RecordFrame(Cloth &cloth);
+};
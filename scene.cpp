@@ -0,0 +1,487 @@
+#include "precomp.h" // only include this header in source files
+
+// forward declarations
+bool LoadPNGFile(const char* fileName, unsigned int& w, unsigned int& h, std::vector<unsigned char>& image);
+
+/* Private methods */
+
+// reads the next word on the current line, returns false at the end of the line
+bool Scene::ReadWord(std::string &word)
+{
+	// skip the whitespace, a comment ends the line
+	while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+		cursor++;
+	if (*cursor == '\0' || *cursor == '\n' || *cursor == '#')
+		return false;
+
+	const char *start = cursor;
+	while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n' && *cursor != '#')
+		cursor++;
+	word.assign(start, cursor);
+	return true;
+}
+
+// reads a number on the current line, returns false and sets the error if the value is missing or malformed
+bool Scene::ReadFloat(float &value)
+{
+	while (*cursor == ' ' || *cursor == '\t')
+		cursor++;
+	char *end;
+	value = strtof(cursor, &end);
+	if (end == cursor || !(*end == '\0' || *end == ' ' || *end == '\t' || *end == '\r' || *end == '\n' || *end == '#'))
+		return Fail("expected a number");
+	cursor = end;
+	return true;
+}
+
+// reads a whole number on the current line, returns false and sets the error if the value is missing or malformed
+bool Scene::ReadInt(int &value)
+{
+	while (*cursor == ' ' || *cursor == '\t')
+		cursor++;
+	char *end;
+	value = (int)strtol(cursor, &end, 10);
+	if (end == cursor || !(*end == '\0' || *end == ' ' || *end == '\t' || *end == '\r' || *end == '\n' || *end == '#'))
+		return Fail("expected a whole number");
+	cursor = end;
+	return true;
+}
+
+// reads three numbers on the current line, returns false and sets the error if a value is missing or malformed
+bool Scene::ReadVec3(Vec3 &value)
+{
+	return ReadFloat(value.f[0]) && ReadFloat(value.f[1]) && ReadFloat(value.f[2]);
+}
+
+// reads on or off on the current line, returns false and sets the error if the value is missing or malformed
+bool Scene::ReadSwitch(bool &value)
+{
+	std::string word;
+	if (!ReadWord(word) || (word != "on" && word != "off"))
+		return Fail("expected on or off");
+	value = (word == "on");
+	return true;
+}
+
+// sets the error with the current line number, always returns false
+bool Scene::Fail(const std::string &message)
+{
+	if (error.empty())
+		error = (line > 0) ? "line " + std::to_string(line) + ": " + message : message;
+	return false;
+}
+
+// returns true if nothing but whitespace and comments are left on the current line, and moves to the next line
+bool Scene::EndLine()
+{
+	std::string word;
+	if (ReadWord(word))
+		return Fail("unexpected " + word);
+
+	while (*cursor != '\0' && *cursor != '\n')
+		cursor++;
+	if (*cursor == '\n')
+		cursor++;
+	line++;
+	return true;
+}
+
+// reads a property of a cloth, returns false and sets the error if the property is unknown or malformed
+bool Scene::ReadClothProperty(const std::string &name, ClothDesc &cloth)
+{
+	if (name == "position")
+		return ReadVec3(cloth.position);
+	if (name == "size")
+		return ReadFloat(cloth.width) && ReadFloat(cloth.height);
+	if (name == "resolution")
+		return ReadInt(cloth.particlesWidth) && ReadInt(cloth.particlesHeight);
+	if (name == "colors")
+		return ReadVec3(cloth.color1) && ReadVec3(cloth.color2);
+	if (name == "iterations")
+	{
+		// the minimum amount of iterations is optional
+		if (!ReadInt(cloth.iterations))
+			return false;
+		cloth.minIterations = cloth.iterations;
+		const char *rest = cursor;
+		std::string word;
+		if (!ReadWord(word))
+			return true;
+		cursor = rest;
+		return ReadInt(cloth.minIterations);
+	}
+	if (name == "tolerance")
+		return ReadFloat(cloth.tolerance);
+	if (name == "stretch")
+		return ReadFloat(cloth.stretchFactor);
+	if (name == "aerodynamics")
+		return ReadFloat(cloth.drag) && ReadFloat(cloth.lift);
+	if (name == "damping")
+		return ReadFloat(cloth.damping);
+	if (name == "chebyshev")
+		return ReadSwitch(cloth.chebyshev);
+	if (name == "multigrid")
+		return ReadSwitch(cloth.multigrid);
+	if (name == "tethers")
+		return ReadSwitch(cloth.tethers);
+	if (name == "tearable")
+		return ReadSwitch(cloth.tearable);
+	if (name == "repeat")
+		return ReadInt(cloth.repeatX) && ReadInt(cloth.repeatZ) && ReadFloat(cloth.spacingX) && ReadFloat(cloth.spacingZ);
+
+	std::string word;
+	if (name == "seed")
+	{
+		char *end;
+		if (!ReadWord(word) || word[0] == '-' || (cloth.seed = strtoull(word.c_str(), &end, 10), *end != '\0'))
+			return Fail("expected a seed");
+		return true;
+	}
+
+	if (name == "pattern")
+	{
+		if (!ReadWord(word))
+			return Fail("expected a pattern");
+		if (word == "vertical") cloth.pattern = Pattern::Vertical;
+		else if (word == "horizontal") cloth.pattern = Pattern::Horizontal;
+		else if (word == "checkerboard") cloth.pattern = Pattern::Checkerboard;
+		else if (word == "random") cloth.pattern = Pattern::Random;
+		else if (word == "image")
+		{
+			// the image is decoded once, and shared by all the cloths that use it
+			std::string fileName;
+			unsigned int w, h;
+			PatternImage *image = new PatternImage();
+			cloth.image.reset(image);
+			if (!ReadWord(fileName))
+				return Fail("expected an image file");
+			if (!std::ifstream(fileName.c_str()).good() || !LoadPNGFile(fileName.c_str(), w, h, image->pixels))
+				return Fail("could not load image " + fileName);
+			image->width = (int)w;
+			image->height = (int)h;
+			cloth.pattern = Pattern::Image;
+		}
+		else return Fail("unknown pattern " + word);
+		return true;
+	}
+	if (name == "texture")
+	{
+		// the texture is decoded once the window is open, so only check that it exists
+		if (!ReadWord(cloth.texture))
+			return Fail("expected a texture file");
+		if (!std::ifstream(cloth.texture.c_str()).good())
+			return Fail("could not open texture " + cloth.texture);
+		return true;
+	}
+	if (name == "solver")
+	{
+		if (!ReadWord(word))
+			return Fail("expected a solver");
+		if (word == "iterative") cloth.solver = Solver::Iterative;
+		else if (word == "projective") cloth.solver = Solver::Projective;
+		else if (word == "implicit") cloth.solver = Solver::Implicit;
+		else return Fail("unknown solver " + word);
+		return true;
+	}
+	if (name == "pins")
+	{
+		// the pinned corners, an empty list pins nothing
+		for (int i = 0; i < 4; i++)
+			cloth.pins[i] = false;
+		while (ReadWord(word))
+		{
+			if (word.size() != 1 || word[0] < '1' || word[0] > '4')
+				return Fail("expected a corner from 1 to 4");
+			cloth.pins[word[0] - '1'] = true;
+		}
+		return true;
+	}
+	return Fail("unknown cloth property " + name);
+}
+
+// reads a property of a sphere, returns false and sets the error if the property is unknown or malformed
+bool Scene::ReadSphereProperty(const std::string &name, SphereDesc &sphere)
+{
+	if (name == "position")
+		return ReadVec3(sphere.position);
+	if (name == "radius")
+		return ReadFloat(sphere.radius);
+	if (name == "color")
+		return ReadVec3(sphere.color);
+	if (name == "swing")
+		return ReadFloat(sphere.amplitude) && ReadFloat(sphere.period);
+	return Fail("unknown sphere property " + name);
+}
+
+// checks if the settings make sense, returns false and sets the error if they don't
+bool Scene::Validate()
+{
+	line = 0;
+	if (cloths.empty())
+		return Fail("a scene needs at least one cloth");
+
+	std::vector<ClothDesc>::iterator c;
+	for (c = cloths.begin(); c != cloths.end(); c++)
+	{
+		// every corner pins 3 particles, so the cloth needs at least 3 particles in both directions
+		if ((*c).width <= 0.0f || (*c).height <= 0.0f)
+			return Fail("the size of a cloth should be positive");
+		if ((*c).particlesWidth < 3 || (*c).particlesHeight < 3)
+			return Fail("the resolution of a cloth should be at least 3 by 3");
+		if ((*c).iterations < 1 || (*c).minIterations < 1 || (*c).minIterations > (*c).iterations)
+			return Fail("a cloth needs at least one iteration, and no more minimum than maximum iterations");
+		if ((*c).tolerance < 0.0f || (*c).stretchFactor <= 0.0f || (*c).drag < 0.0f || (*c).lift < 0.0f)
+			return Fail("the tolerance, stretch and aerodynamics of a cloth can't be negative");
+		if ((*c).damping < 0.0f || (*c).damping >= 1.0f)
+			return Fail("the damping of a cloth should be at least 0 and less than 1");
+		if ((*c).repeatX < 1 || (*c).repeatZ < 1 || (*c).repeatX * (*c).repeatZ > 10000)
+			return Fail("a cloth should be repeated between 1 and 10000 times");
+	}
+
+	std::vector<SphereDesc>::iterator s;
+	for (s = spheres.begin(); s != spheres.end(); s++)
+	{
+		if ((*s).radius <= 0.1f)
+			return Fail("the radius of a sphere should be larger than 0.1");
+		if ((*s).amplitude != 0.0f && (*s).period <= 0.0f)
+			return Fail("the period of a swinging sphere should be positive");
+	}
+	return true;
+}
+
+// replaces the repeated cloths by their copies
+void Scene::ExpandRepeats()
+{
+	std::vector<ClothDesc> expanded;
+	std::vector<ClothDesc>::iterator c;
+	for (c = cloths.begin(); c != cloths.end(); c++)
+		for (int z = 0; z < (*c).repeatZ; z++)
+			for (int x = 0; x < (*c).repeatX; x++)
+			{
+				// every copy gets its own seed, so they don't tear the same way
+				ClothDesc copy = *c;
+				copy.position = (*c).position + Vec3(x * (*c).spacingX, 0.0f, z * (*c).spacingZ);
+				copy.repeatX = copy.repeatZ = 1;
+				if (copy.seed != 0)
+					copy.seed += x + z * (*c).repeatX;
+				expanded.push_back(copy);
+			}
+	cloths.swap(expanded);
+}
+
+// gives the cloths without a seed a fixed one, unless the scene isn't deterministic
+void Scene::SeedCloths()
+{
+	if (!deterministic)
+		return;
+	for (size_t i = 0; i < cloths.size(); i++)
+		if (cloths[i].seed == 0)
+			cloths[i].seed = i + 1;
+}
+
+/* Public methods */
+
+// constructor, creates the default scene
+Scene::Scene()
+	: cursor(NULL), line(0), gravity(Vec3(0.0f, -0.2f, 0.0f)), wind(Vec3(0.5f, 0.0f, 0.2f)), deterministic(true)
+{
+	cloths.push_back(DefaultCloth());
+	SeedCloths();
+
+	// a ball that swings through the cloth
+	SphereDesc ball = DefaultSphere();
+	ball.position = Vec3(7.0f, -5.0f, 0.0f);
+	ball.radius = 2.0f;
+	ball.color = Vec3(1.0f, 0.0f, 0.0f);
+	ball.amplitude = -7.0f;
+	ball.period = 50.0f;
+	spheres.push_back(ball);
+
+	// a large sphere below the cloth that acts as the floor
+	SphereDesc floor = DefaultSphere();
+	floor.position = Vec3(7.0f, -215.0f, 0.0f);
+	floor.radius = 200.1f;
+	floor.color = Vec3(0.486f, 0.988f, 0.0f);
+	spheres.push_back(floor);
+}
+
+// returns the default settings of a cloth
+ClothDesc Scene::DefaultCloth()
+{
+	ClothDesc desc;
+	desc.position = Vec3(0.0f, 0.0f, 0.0f);
+	desc.width = 14.0f;
+	desc.height = 10.0f;
+	desc.particlesWidth = 60;
+	desc.particlesHeight = 45;
+	desc.pattern = Pattern::Horizontal;
+	desc.color1 = Vec3(0.0f, 0.8f, 1.0f);
+	desc.color2 = Vec3(1.0f, 1.0f, 1.0f);
+	desc.iterations = desc.minIterations = 15;
+	desc.tolerance = 0.0f;
+	desc.stretchFactor = 1.0f;
+	desc.drag = 1.0f;
+	desc.lift = 0.5f;
+	desc.damping = DAMPING;
+	desc.solver = Solver::Iterative;
+	desc.chebyshev = desc.multigrid = desc.tethers = desc.tearable = false;
+	desc.pins[0] = desc.pins[1] = true;
+	desc.pins[2] = desc.pins[3] = false;
+	desc.seed = 0;
+	desc.repeatX = desc.repeatZ = 1;
+	desc.spacingX = desc.spacingZ = 0.0f;
+	return desc;
+}
+
+// returns the default settings of a sphere
+SphereDesc Scene::DefaultSphere()
+{
+	SphereDesc desc;
+	desc.position = Vec3(0.0f, 0.0f, 0.0f);
+	desc.radius = 1.0f;
+	desc.color = Vec3(1.0f, 1.0f, 1.0f);
+	desc.amplitude = 0.0f;
+	desc.period = 1.0f;
+	return desc;
+}
+
+// loads a scene file, returns false if the file can't be read or isn't valid, the scene is unchanged in that case
+bool Scene::Load(const char* fileName)
+{
+	error.clear();
+
+	// read the whole file at once
+	FILE *file = fopen(fileName, "rb");
+	if (!file)
+	{
+		error = std::string("could not open ") + fileName;
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	text.resize(std::max(size, 0L) + 1);
+	size_t read = (size > 0) ? fread(&text[0], 1, size, file) : 0;
+	fclose(file);
+	text[read] = '\0';
+
+	// parse into a copy, so a failed load leaves the scene unchanged
+	Scene loaded;
+	loaded.cloths.clear();
+	loaded.spheres.clear();
+	ClothDesc *cloth = NULL;
+	SphereDesc *sphere = NULL;
+
+	cursor = &text[0];
+	line = 1;
+	std::string name;
+	while (*cursor != '\0')
+	{
+		if (ReadWord(name))
+		{
+			// a cloth or sphere starts a block, the lines that follow are its properties
+			bool valid = true;
+			if (name == "cloth")
+			{
+				loaded.cloths.push_back(DefaultCloth());
+				cloth = &loaded.cloths.back();
+				sphere = NULL;
+			}
+			else if (name == "sphere")
+			{
+				loaded.spheres.push_back(DefaultSphere());
+				sphere = &loaded.spheres.back();
+				cloth = NULL;
+			}
+			else if (name == "gravity")
+				valid = ReadVec3(loaded.gravity);
+			else if (name == "wind")
+				valid = ReadVec3(loaded.wind);
+			else if (name == "deterministic")
+				valid = ReadSwitch(loaded.deterministic);
+			else if (cloth)
+				valid = ReadClothProperty(name, *cloth);
+			else if (sphere)
+				valid = ReadSphereProperty(name, *sphere);
+			else
+				valid = Fail("unknown setting " + name);
+
+			if (!valid)
+				return false;
+		}
+		if (!EndLine())
+			return false;
+	}
+
+	// check the scene before using it
+	std::swap(loaded.cloths, cloths);
+	std::swap(loaded.spheres, spheres);
+	if (!Validate())
+	{
+		std::swap(loaded.cloths, cloths);
+		std::swap(loaded.spheres, spheres);
+		return false;
+	}
+	gravity = loaded.gravity;
+	wind = loaded.wind;
+	deterministic = loaded.deterministic;
+	ExpandRepeats();
+	SeedCloths();
+	return true;
+}
+
+// creates a cloth with the settings of a cloth description
+template<typename V>
+BasicCloth<V>* Scene::CreateCloth(const ClothDesc &desc)
+{
+	BasicCloth<V> *cloth = new BasicCloth<V>(desc.position, desc.width, desc.height, desc.particlesWidth, desc.particlesHeight,
+		desc.pattern, desc.color1, desc.color2, desc.iterations, desc.stretchFactor, desc.seed);
+	cloth->SetTolerance(desc.tolerance, desc.minIterations, desc.iterations);
+	cloth->SetAerodynamics(desc.drag, desc.lift);
+	cloth->SetDamping(desc.damping);
+	cloth->SetProjective(desc.solver == Solver::Projective);
+	cloth->SetImplicit(desc.solver == Solver::Implicit);
+	cloth->SetChebyshev(desc.chebyshev);
+	cloth->SetMultigrid(desc.multigrid);
+	cloth->SetTethers(desc.tethers);
+	cloth->SetTearable(desc.tearable);
+	if (desc.pattern == Pattern::Image && desc.image && !desc.image->pixels.empty())
+		cloth->SetPatternImage(&desc.image->pixels[0], desc.image->width, desc.image->height);
+	ApplyPins(*cloth, desc);
+	return cloth;
+}
+
+// pins the corners of a cloth as given by its description, for example after the cloth has been reset
+template<typename V>
+void Scene::ApplyPins(BasicCloth<V> &cloth, const ClothDesc &desc)
+{
+	// a new or reset cloth has its top 2 corners pinned
+	for (int corner = 1; corner <= 4; corner++)
+		if (desc.pins[corner - 1] != (corner <= 2))
+			cloth.SwitchCorner(corner);
+}
+
+// creates the drawable sphere of a sphere description
+Sphere Scene::CreateSphere(const SphereDesc &desc)
+{
+	// the spheres are drawn with the y and z axes swapped, and slightly smaller so the cloth doesn't clip through them
+	Vec3 pos = GetSpherePosition(desc, 0.0f);
+	return Sphere(Vec3(pos.f[0], -pos.f[2], pos.f[1]), desc.color, desc.radius - 0.1f, 36, 18);
+}
+
+// returns the position of a sphere after a certain amount of timesteps
+Vec3 Scene::GetSpherePosition(const SphereDesc &desc, float time)
+{
+	Vec3 pos = desc.position;
+	if (desc.amplitude != 0.0f)
+		pos.f[2] += desc.amplitude * cos(time / desc.period);
+	return pos;
+}
+
+// the cloths are created in float, in double for offline runs, and in float vectors padded for sse2
+template BasicCloth<Vec3>* Scene::CreateCloth<Vec3>(const ClothDesc &desc);
+template BasicCloth<Vec3d>* Scene::CreateCloth<Vec3d>(const ClothDesc &desc);
+template BasicCloth<Vec3a>* Scene::CreateCloth<Vec3a>(const ClothDesc &desc);
+template void Scene::ApplyPins<Vec3>(BasicCloth<Vec3> &cloth, const ClothDesc &desc);
+template void Scene::ApplyPins<Vec3d>(BasicCloth<Vec3d> &cloth, const ClothDesc &desc);
+template void Scene::ApplyPins<Vec3a>(BasicCloth<Vec3a> &cloth, const ClothDesc &desc);
@@ -0,0 +1,115 @@
+// the solvers a cloth in a scene can use
+enum class Solver { Iterative, Projective, Implicit };
+
+/* a decoded image used as the pattern of a cloth, 4 bytes per pixel */
+struct PatternImage
+{
+	int width, height;
+	std::vector<unsigned char> pixels;
+};
+
+/* settings of a cloth in a scene */
+struct ClothDesc
+{
+	Vec3 position;                       // the position of the top left corner in world
+	float width, height;                 // the width and height of the cloth
+	int particlesWidth, particlesHeight; // number of particles in the cloth
+	Pattern pattern;                     // the cloth pattern
+	Vec3 color1, color2;                 // the color(s) of the cloth
+	std::shared_ptr<PatternImage> image; // the image of the image pattern, shared by the repeated cloths
+	std::string texture;                 // the PNG file the cloth is textured with, drawn with the pattern if it is empty
+	int iterations, minIterations;       // the maximum and minimum amount of constraint iterations
+	float tolerance;                     // the constraint tolerance, zero always does all the iterations
+	float stretchFactor;                 // the factor with which the constraints can stretch before they break
+	float drag, lift;                    // the aerodynamic coefficients
+	float damping;                       // the fraction of the velocity that is lost every timestep
+	Solver solver;                       // the solver used for the constraints
+	bool chebyshev, multigrid, tethers;  // the optional accelerations of the solver
+	bool tearable;                       // is the cloth tearable or not
+	bool pins[4];                        // are the corners pinned or not, clockwise from top left
+	unsigned long long seed;             // the seed of the random streams of the cloth, zero picks a fixed one unless the scene isn't deterministic
+	int repeatX, repeatZ;                // the cloth is repeated in a grid on the xz plane when the scene is loaded
+	float spacingX, spacingZ;            // the distance between the repeated cloths
+};
+
+/* settings of a sphere collider in a scene */
+struct SphereDesc
+{
+	Vec3 position;           // the center of the sphere in world
+	float radius;            // the radius the cloth collides with, the sphere is drawn slightly smaller
+	Vec3 color;              // the color of the sphere
+	float amplitude, period; // the sphere swings along the z axis as amplitude * cos(timesteps / period)
+};
+
+/* a scene with cloths, colliders and force fields, loaded from a text file */
+class Scene
+{
+private:
+	// the text that is being parsed and the current position and line in it
+	std::vector<char> text;
+	const char *cursor;
+	int line;
+
+	// the reason the last load failed
+	std::string error;
+
+	// reads the next word on the current line, returns false at the end of the line
+	bool ReadWord(std::string &word);
+
+	// read values on the current line, returns false and sets the error if the value is missing or malformed
+	bool ReadFloat(float &value);
+	bool ReadInt(int &value);
+	bool ReadVec3(Vec3 &value);
+	bool ReadSwitch(bool &value);
+
+	// sets the error with the current line number, always returns false
+	bool Fail(const std::string &message);
+
+	// returns true if nothing but whitespace and comments are left on the current line, and moves to the next line
+	bool EndLine();
+
+	// reads a property of a cloth or a sphere, returns false and sets the error if the property is unknown or malformed
+	bool ReadClothProperty(const std::string &name, ClothDesc &cloth);
+	bool ReadSphereProperty(const std::string &name, SphereDesc &sphere);
+
+	// checks if the settings make sense, returns false and sets the error if they don't
+	bool Validate();
+
+	// replaces the repeated cloths by their copies
+	void ExpandRepeats();
+
+	// gives the cloths without a seed a fixed one, unless the scene isn't deterministic
+	void SeedCloths();
+
+public:
+	// the contents of the scene
+	std::vector<ClothDesc> cloths;
+	std::vector<SphereDesc> spheres;
+	Vec3 gravity, wind; // the forces on the cloths, given per timestep squared
+	bool deterministic; // on by default, every cloth gets a fixed seed so the same scene and input always give the same simulation
+
+	// constructor, creates the default scene
+	Scene();
+
+	// returns the default settings of a cloth and a sphere
+	static ClothDesc DefaultCloth();
+	static SphereDesc DefaultSphere();
+
+	// loads a scene file, returns false if the file can't be read or isn't valid, the scene is unchanged in that case
+	bool Load(const char* fileName);
+
+	// returns the reason the last load failed
+	const std::string& GetError() { return error; }
+
+	// creates a cloth with the settings of a cloth description, simulated in the precision of the vector type
+	template<typename V> static BasicCloth<V>* CreateCloth(const ClothDesc &desc);
+
+	// pins the corners of a cloth as given by its description, for example after the cloth has been reset
+	template<typename V> static void ApplyPins(BasicCloth<V> &cloth, const ClothDesc &desc);
+
+	// creates the drawable sphere of a sphere description
+	static Sphere CreateSphere(const SphereDesc &desc);
+
+	// returns the position of a sphere after a certain amount of timesteps
+	static Vec3 GetSpherePosition(const SphereDesc &desc, float time);
+};
@@ -12,44 +12,138 @@ float distance = -12.f;
 
 // key logic
 int oldState_1, oldState_2, oldState_3, oldState_4;
-int oldState_r, oldState_t, oldState_s, oldState_w, oldState_b, oldState_space;
+int oldState_r, oldState_t, oldState_s, oldState_w, oldState_b, oldState_c, oldState_h, oldState_p, oldState_l, oldState_f5, oldState_f9, oldState_v, oldState_o, oldState_e, oldState_space;
 bool update = false, updateWindForce = true, updateBallPos = true;
 
-// initialize cloth object
-Cloth cloth(Vec3(0.0f, 0.0f, 0.0f), 14, 10, 60, 45, Pattern::Horizontal, Vec3(0.0f, 0.8f, 1.0f), Vec3(1.0f, 1.0f, 1.0f));
+// the scene, the default one unless a scene file is given
+Scene scene;
 
-// initialize sphere object
-float ballT = 0;
-float ballRadius = 2.0f;
-Sphere sphere(Vec3(7, cos(0 / 50.0) * 7, -5), Vec3(1.0f, 0.0f, 0.0f), ballRadius - 0.1f, 36, 18);
+// the cloths and spheres of the scene, created once the scene is loaded, and the threads that update them
+ThreadPool *pool = NULL;
+World *world = NULL;
+double stepTime = 0.0;
 
-// floor sphere
-Sphere floorSphere(Vec3(7, 0, -215), Vec3(0.486f, 0.988f, 0.0f), 200.0f);
+// the textures of the cloths, every image is only decoded once
+TextureCache *textures = NULL;
+
+// records the cloth while it is being simulated, or plays back a recording instead of simulating
+Recorder *recorder = NULL;
+Player *player = NULL;
+
+// exports the cloth as a mesh sequence while it is being simulated
+Exporter *exporter = NULL;
+
+// forward declarations
+bool LoadPNGFile(const char* fileName, unsigned int& w, unsigned int& h, std::vector<unsigned char>& image);
+
+// decodes every image of a corpus a few times, and prints the fastest decode time and throughput of every image and the corpus
+int BenchmarkDecode(int fileCount, char** fileNames)
+{
+	const int repeats = 10;
+	double totalMs = 0.0, totalBytes = 0.0;
+	std::vector<unsigned char> image;
+	for (int i = 0; i < fileCount; i++)
+	{
+		unsigned int w = 0, h = 0;
+		double best = DBL_MAX;
+		for (int r = 0; r < repeats; r++)
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			bool loaded = LoadPNGFile(fileNames[i], w, h, image);
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			if (!loaded)
+			{
+				std::cout << "could not decode " << fileNames[i] << std::endl;
+				return -1;
+			}
+			best = std::min(best, elapsed.count());
+		}
+
+		// the throughput is measured in decoded bytes
+		double bytes = 4.0 * w * h;
+		printf("%s: %ux%u, %.3f ms, %.1f MB/s\n", fileNames[i], w, h, best, bytes / (best * 1000.0));
+		totalMs += best;
+		totalBytes += bytes;
+	}
+	if (fileCount > 0)
+		printf("%d images: %.3f ms, %.1f MB/s\n", fileCount, totalMs, totalBytes / (totalMs * 1000.0));
+	return 0;
+}
+
+// steps a scene in a certain precision, prints the time per step, the energy and the tears of its cloths,
+// and how far the particles drifted from a reference run
+template<typename V>
+void BenchmarkWorld(const char *name, const Scene &benchScene, int steps, std::vector<double> &positions, const std::vector<double> &reference)
+{
+	// the world is stepped on the current thread with the wind on and the spheres moving, like a sweep
+	ThreadPool serial(0);
+	BasicWorld<V> bench(benchScene, serial);
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < steps; i++)
+		bench.Step(true, true);
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	// gather the positions of all the cloths
+	double energy = 0.0;
+	int tears = 0;
+	positions.clear();
+	for (int c = 0; c < bench.GetClothCount(); c++)
+	{
+		BasicCloth<V> &cloth = bench.GetCloth(c);
+		size_t offset = positions.size();
+		positions.resize(offset + 3 * cloth.GetParticlesWidth() * cloth.GetParticlesHeight());
+		cloth.CopyPositions(&positions[offset]);
+		energy += cloth.GetKineticEnergy();
+		tears += cloth.GetTearCount();
+	}
+
+	// the drift is the largest and the root mean square distance to the reference positions
+	double maxDrift = 0.0, sumDrift = 0.0;
+	for (size_t i = 0; i < reference.size() && i < positions.size(); i += 3)
+	{
+		Vec3d offset = Vec3d(positions[i], positions[i + 1], positions[i + 2]) - Vec3d(reference[i], reference[i + 1], reference[i + 2]);
+		double drift = offset.Length();
+		maxDrift = std::max(maxDrift, drift);
+		sumDrift += drift * drift;
+	}
+	printf("%-8s %8.4f ms/step, energy %.6e, %d tears, drift max %.3e rms %.3e\n", name, steps ? elapsed.count() / steps : 0.0,
+		energy, tears, maxDrift, positions.empty() ? 0.0 : sqrt(3.0 * sumDrift / positions.size()));
+}
+
+// runs the cloths of a scene in double, float and padded float, the drift of the float runs is measured against the double run
+int BenchmarkPrecision(int steps, Scene benchScene)
+{
+	std::vector<double> reference, positions;
+	printf("%d steps of %d cloths\n", steps, (int)benchScene.cloths.size());
+	BenchmarkWorld<Vec3d>("double", benchScene, steps, reference, std::vector<double>());
+	BenchmarkWorld<Vec3>("float", benchScene, steps, positions, reference);
+	BenchmarkWorld<Vec3a>("float x4", benchScene, steps, positions, reference);
+	return 0;
+}
 
 // draws the current frame to the application window
 void Draw(void)
 {
-    if (update)
+	// play the recording
+	if (update && player)
+		player->Step(1);
+
+    if (update && !player)
     {
-        // calculate ball positions
-		if (updateBallPos)
+        // move the balls, add forces to the cloths, update the particle positions and resolve the collisions
+		double start = glfwGetTime();
+		world->Step(updateWindForce, updateBallPos);
+		stepTime = glfwGetTime() - start;
+
+		// record the new positions of the first cloth, and stop recording if the file can't be written
+		if (recorder && !recorder->RecordFrame(world->GetCloth(0)))
 		{
-			ballT++;
-			float y = cos(ballT / 50.0) * 7;
-			sphere.UpdatePosition(y);
+			std::cout << "could not write cloth.rec" << std::endl;
+			delete recorder;
+			recorder = NULL;
 		}
-
-        // add forces to the cloth and update the particle positions
-        cloth.AddForce(Vec3(0, -0.2, 0) * TIMESTEP2);
-		if (updateWindForce)
-			cloth.AddWindForce(Vec3(0.5, 0, 0.2) * TIMESTEP2);
-        cloth.Update();
-
-        // resolve collision with the balls
-		Vec3 spherePos = sphere.GetPosition();
-        cloth.SphereCollision(Vec3(spherePos.f[0], spherePos.f[2], -spherePos.f[1]), ballRadius);
-		Vec3 floorSpherePos = floorSphere.GetPosition();
-		cloth.SphereCollision(Vec3(floorSpherePos.f[0], floorSpherePos.f[2], -floorSpherePos.f[1]), 200.1f);
+		if (exporter)
+			exporter->ExportFrame(world->GetCloth(0));
     }
 
 	// drawing
@@ -72,44 +166,64 @@ void Draw(void)
     glTranslatef(0, 0, distance);
     // then rotate the camera
 	glRotatef(camera.yaw, 0, 1, 0);
-    // then translate to the center of the cloth
-    glTranslatef(-7, 5, 0);
+    // then translate to the center of the cloths
+	Vec3 low = scene.cloths[0].position, high = low;
+	for (size_t i = 0; i < scene.cloths.size(); i++)
+	{
+		const ClothDesc &desc = scene.cloths[i];
+		for (int k = 0; k < 3; k++)
+		{
+			low.f[k] = std::min(low.f[k], desc.position.f[k] - (k == 1 ? desc.height : 0.0f));
+			high.f[k] = std::max(high.f[k], desc.position.f[k] + (k == 0 ? desc.width : 0.0f));
+		}
+	}
+    glTranslatef(-(low.f[0] + high.f[0]) / 2, -(low.f[1] + high.f[1]) / 2, -(low.f[2] + high.f[2]) / 2);
 	 
 	// draw sphere
 	glPushMatrix();
 	glRotatef(-90, 1, 0, 0); // <-- THIS REALLY NEEDS TO BE CHANGED TO USE WORLD COORDS
-	sphere.Draw();
-	floorSphere.Draw();
+	// the moving spheres aren't part of a recording
+	world->DrawSpheres(!player);
 	glPopMatrix();
 
-	// draw the cloth
-	cloth.DrawShaded();
+	// draw the cloths, or the current frame of the recording
+	if (player)
+		player->Draw(scene.cloths[0].color1);
+	else
+		world->DrawCloths(*textures);
 }
 
 // handles the user input
 void HandleInput(GLFWwindow* window)
 {
 	// keys for making corners static or dynamic, clockwise from top left
+	// during playback they jump to the start, a quarter, half and three quarters of the recording
 	int state_1 = glfwGetKey(window, GLFW_KEY_1);
 	if (state_1 == GLFW_RELEASE && oldState_1 == GLFW_PRESS)
-		cloth.SwitchCorner(1);
+		player ? player->Seek(0) : world->SwitchCorner(1);
 	oldState_1 = state_1;
 
 	int state_2 = glfwGetKey(window, GLFW_KEY_2);
 	if (state_2 == GLFW_RELEASE && oldState_2 == GLFW_PRESS)
-		cloth.SwitchCorner(2);
+		player ? player->Seek(player->GetFrameCount() / 4) : world->SwitchCorner(2);
 	oldState_2 = state_2;
 
 	int state_3 = glfwGetKey(window, GLFW_KEY_3);
 	if (state_3 == GLFW_RELEASE && oldState_3 == GLFW_PRESS)
-		cloth.SwitchCorner(3);
+		player ? player->Seek(player->GetFrameCount() / 2) : world->SwitchCorner(3);
 	oldState_3 = state_3;
 
 	int state_4 = glfwGetKey(window, GLFW_KEY_4);
 	if (state_4 == GLFW_RELEASE && oldState_4 == GLFW_PRESS)
-		cloth.SwitchCorner(4);
+		player ? player->Seek(player->GetFrameCount() * 3 / 4) : world->SwitchCorner(4);
 	oldState_4 = state_4;
 
+	// scrub through the recording while the arrow keys are held
+	if (player && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+		player->Step(1);
+	if (player && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+		player->Step(-1);
+
 	// get the current mouse position and calculate the delta to find mouse change
 	glfwGetCursorPos(window, &xMouse, &yMouse);
 	double deltaXMouse = xMouse - xPrevMouse;
@@ -133,22 +247,27 @@ void HandleInput(GLFWwindow* window)
     if (state_minus == GLFW_PRESS)
         distance-=0.25f;
 
-	// resets the cloth
+	// resets the cloth, or rewinds the recording
 	int state_r = glfwGetKey(window, GLFW_KEY_R);
 	if (state_r == GLFW_RELEASE && oldState_r == GLFW_PRESS)
-		cloth.ResetCloth();
+	{
+		if (player)
+			player->Seek(0);
+		else
+			world->Reset();
+	}
 	oldState_r = state_r;
 
 	// makes the cloth tearable or not
 	int state_t = glfwGetKey(window, GLFW_KEY_T);
 	if (state_t == GLFW_RELEASE && oldState_t == GLFW_PRESS)
-		cloth.SwitchTearable();
+		world->ForEachCloth(&Cloth::SwitchTearable);
 	oldState_t = state_t;
 
 	// show the cloth tears or not
 	int state_s = glfwGetKey(window, GLFW_KEY_S);
 	if (state_s == GLFW_RELEASE && oldState_s == GLFW_PRESS)
-		cloth.SwitchShowTears();
+		world->ForEachCloth(&Cloth::SwitchShowTears);
 	oldState_s = state_s;
 
 	// add wind forces or not
@@ -163,6 +282,94 @@ void HandleInput(GLFWwindow* window)
 		updateBallPos = !updateBallPos;
 	oldState_b = state_b;
 
+	// accelerate the constraint iterations or not
+	int state_c = glfwGetKey(window, GLFW_KEY_C);
+	if (state_c == GLFW_RELEASE && oldState_c == GLFW_PRESS)
+		world->ForEachCloth(&Cloth::SwitchChebyshev);
+	oldState_c = state_c;
+
+	// solve the coarse grids of the cloth or not
+	int state_h = glfwGetKey(window, GLFW_KEY_H);
+	if (state_h == GLFW_RELEASE && oldState_h == GLFW_PRESS)
+		world->ForEachCloth(&Cloth::SwitchMultigrid);
+	oldState_h = state_h;
+
+	// use projective dynamics or the constraint iterations
+	int state_p = glfwGetKey(window, GLFW_KEY_P);
+	if (state_p == GLFW_RELEASE && oldState_p == GLFW_PRESS)
+		world->ForEachCloth(&Cloth::SwitchProjective);
+	oldState_p = state_p;
+
+	// tether the cloth to its pinned corners or not
+	int state_l = glfwGetKey(window, GLFW_KEY_L);
+	if (state_l == GLFW_RELEASE && oldState_l == GLFW_PRESS)
+		world->ForEachCloth(&Cloth::SwitchTethers);
+	oldState_l = state_l;
+
+	// save or restore the state of the cloth
+	int state_f5 = glfwGetKey(window, GLFW_KEY_F5);
+	if (state_f5 == GLFW_RELEASE && oldState_f5 == GLFW_PRESS)
+		world->GetCloth(0).SaveState("cloth.state");
+	oldState_f5 = state_f5;
+
+	int state_f9 = glfwGetKey(window, GLFW_KEY_F9);
+	if (state_f9 == GLFW_RELEASE && oldState_f9 == GLFW_PRESS)
+		world->GetCloth(0).LoadState("cloth.state");
+	oldState_f9 = state_f9;
+
+	// start or stop recording the cloth
+	int state_v = glfwGetKey(window, GLFW_KEY_V);
+	if (state_v == GLFW_RELEASE && oldState_v == GLFW_PRESS)
+	{
+		if (recorder)
+		{
+			delete recorder;
+			recorder = NULL;
+		}
+		else
+			recorder = new Recorder("cloth.rec", world->GetCloth(0));
+	}
+	oldState_v = state_v;
+
+	// start exporting the cloth as obj meshes, switch to ply meshes, or stop exporting
+	int state_e = glfwGetKey(window, GLFW_KEY_E);
+	if (state_e == GLFW_RELEASE && oldState_e == GLFW_PRESS)
+	{
+		if (!exporter)
+			exporter = new Exporter("cloth_", world->GetCloth(0), MeshFormat::Obj);
+		else
+		{
+			bool obj = exporter->GetFormat() == MeshFormat::Obj;
+			delete exporter;
+			exporter = obj ? new Exporter("cloth_", world->GetCloth(0), MeshFormat::Ply) : NULL;
+		}
+	}
+	oldState_e = state_e;
+
+	// start or stop playing back the recording
+	int state_o = glfwGetKey(window, GLFW_KEY_O);
+	if (state_o == GLFW_RELEASE && oldState_o == GLFW_PRESS)
+	{
+		if (player)
+		{
+			delete player;
+			player = NULL;
+		}
+		else
+		{
+			// finish the recording first, so it can be played back
+			delete recorder;
+			recorder = NULL;
+			player = new Player("cloth.rec");
+			if (!player->IsOpen())
+			{
+				delete player;
+				player = NULL;
+			}
+		}
+	}
+	oldState_o = state_o;
+
 	// pause or play the simulation
 	int state_space = glfwGetKey(window, GLFW_KEY_SPACE);
     if (state_space == GLFW_RELEASE && oldState_space == GLFW_PRESS)
@@ -175,8 +382,56 @@ void HandleInput(GLFWwindow* window)
 		glfwSetWindowShouldClose(window, true);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	// run a parameter sweep without opening a window
+	if (argc >= 3 && strcmp(argv[1], "--sweep") == 0)
+	{
+		Sweep sweep;
+		if (!sweep.Load(argv[2]))
+		{
+			std::cout << "could not load sweep " << argv[2] << ": " << sweep.GetError() << std::endl;
+			return -1;
+		}
+		const char *output = (argc >= 4) ? argv[3] : "sweep.csv";
+		ThreadPool sweepPool;
+		if (!sweep.Execute(sweepPool, output))
+		{
+			std::cout << "could not write " << output << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	// benchmark decoding a corpus of images without opening a window
+	if (argc >= 2 && strcmp(argv[1], "--decode-bench") == 0)
+		return BenchmarkDecode(argc - 2, argv + 2);
+
+	// benchmark the solver in every precision without opening a window, on the default scene or on a scene file
+	if (argc >= 2 && strcmp(argv[1], "--precision-bench") == 0)
+	{
+		if (argc >= 4 && !scene.Load(argv[3]))
+		{
+			std::cout << "could not load scene " << argv[3] << ": " << scene.GetError() << std::endl;
+			return -1;
+		}
+		return BenchmarkPrecision((argc >= 3) ? std::max(atoi(argv[2]), 0) : 1000, scene);
+	}
+
+	// load the scene files given on the command line, recordings are played back once the window is open
+	const char *recording = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		size_t length = strlen(argv[i]);
+		if (length > 4 && strcmp(argv[i] + length - 4, ".rec") == 0)
+			recording = argv[i];
+		else if (!scene.Load(argv[i]))
+		{
+			std::cout << "could not load scene " << argv[i] << ": " << scene.GetError() << std::endl;
+			return -1;
+		}
+	}
+
 	// GLFW initialization
 	GLFWwindow* window;
 	if (!glfwInit()) return -1;
@@ -188,8 +443,31 @@ int main()
 	// initialize OpenGL and reshape the window correctly
 	OGLHelper.InitOpenGL();
 
-	// seed the randomizer
-	srand(time(0));
+	// a scene that isn't deterministic gives the cloths without a seed one from the clock
+	if (!scene.deterministic)
+		for (size_t i = 0; i < scene.cloths.size(); i++)
+			if (scene.cloths[i].seed == 0)
+				scene.cloths[i].seed = Random::Hash((unsigned long long)time(0), i);
+
+	// create the cloths and the spheres of the scene
+	pool = new ThreadPool();
+	world = new World(scene, *pool);
+
+	// decode the textures on the workers, the cloths are drawn without them until they are ready
+	textures = new TextureCache(*pool);
+	world->RequestTextures(*textures);
+
+	// play back a recording if one is given
+	if (recording)
+	{
+		player = new Player(recording);
+		if (!player->IsOpen())
+		{
+			std::cout << "could not open recording " << recording << std::endl;
+			delete player;
+			player = NULL;
+		}
+	}
 
 	// render loop
 	while (!glfwWindowShouldClose(window))
@@ -200,12 +478,30 @@ int main()
         // display the window
 		Draw();
 
+		// show the solver cost and accuracy of the last update, or the current frame of the recording in the title
+		if (update || player)
+		{
+			char title[192];
+			if (player)
+				snprintf(title, sizeof(title), "Simulator v1.0 - playback frame %d / %d", player->GetFrame() + 1, player->GetFrameCount());
+			else
+				snprintf(title, sizeof(title), "Simulator v1.0 - %d cloths, step: %.2f ms, iterations: %d, residual max: %.4f rms: %.4f",
+					world->GetClothCount(), stepTime * 1000.0, world->GetCloth(0).GetIterations(), world->GetCloth(0).GetMaxResidual(), world->GetCloth(0).GetRmsResidual());
+			glfwSetWindowTitle(window, title);
+		}
+
 		// swap buffers and check/call events
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
-	// terminate and quit
+	// finish the recording and playback, terminate and quit
+	delete recorder;
+	delete player;
+	delete exporter;
+	delete world;
+	delete textures;
+	delete pool;
 	glfwTerminate();
 	return 0;
 }
\ No newline at end of file
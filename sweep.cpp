@@ -0,0 +1,153 @@
+#include "precomp.h" // only include this header in source files
+
+/* Private methods */
+
+// simulates a single run and fills in its results
+void Sweep::Simulate(Run &run)
+{
+	// a world with only this cloth, stepped on the current thread
+	Scene runScene = scene;
+	ClothDesc desc = scene.cloths[0];
+	desc.iterations = run.iterations;
+	desc.minIterations = std::min(desc.minIterations, run.iterations);
+	desc.stretchFactor = run.stretch;
+	desc.damping = run.damping;
+	desc.particlesWidth = run.width;
+	desc.particlesHeight = run.height;
+	desc.seed = run.seed;
+	runScene.cloths.assign(1, desc);
+	ThreadPool serial(0);
+	World world(runScene, serial);
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < steps; i++)
+		world.Step(true, true);
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	Cloth &cloth = world.GetCloth(0);
+	run.energy = cloth.GetKineticEnergy();
+	run.maxStretch = cloth.GetMaxStretch();
+	run.tears = cloth.GetTearCount();
+	run.msPerStep = steps ? elapsed.count() / steps : 0.0;
+}
+
+/* Public methods */
+
+// loads a sweep file, returns false if the file can't be read or isn't valid
+bool Sweep::Load(const char* fileName)
+{
+	error.clear();
+	std::ifstream file(fileName);
+	if (!file.is_open())
+	{
+		error = std::string("could not open ") + fileName;
+		return false;
+	}
+
+	std::string text, name;
+	for (int line = 1; std::getline(file, text); line++)
+	{
+		// skip comments and empty lines
+		text = text.substr(0, text.find('#'));
+		std::istringstream words(text);
+		if (!(words >> name))
+			continue;
+
+		bool valid = true;
+		if (name == "scene")
+		{
+			std::string sceneName;
+			valid = (words >> sceneName) && scene.Load(sceneName.c_str());
+			if (!valid && !scene.GetError().empty())
+				name = "scene (" + scene.GetError() + ")";
+		}
+		else if (name == "steps")
+			valid = (words >> steps) && steps > 0;
+		else if (name == "iterations")
+		{
+			for (int value; words >> value; )
+				iterations.push_back(value);
+			valid = words.eof() && !iterations.empty() && *std::min_element(iterations.begin(), iterations.end()) >= 1;
+		}
+		else if (name == "stretch")
+		{
+			for (float value; words >> value; )
+				stretches.push_back(value);
+			valid = words.eof() && !stretches.empty() && *std::min_element(stretches.begin(), stretches.end()) > 0.0f;
+		}
+		else if (name == "damping")
+		{
+			for (float value; words >> value; )
+				dampings.push_back(value);
+			valid = words.eof() && !dampings.empty() && *std::min_element(dampings.begin(), dampings.end()) >= 0.0f &&
+				*std::max_element(dampings.begin(), dampings.end()) < 1.0f;
+		}
+		else if (name == "resolution")
+		{
+			// every resolution is written as width x height, for example 60x45
+			for (std::string value; words >> value; )
+			{
+				int w = 0, h = 0;
+				char separator = 0;
+				std::istringstream parts(value);
+				if (!(parts >> w >> separator >> h) || separator != 'x' || w < 3 || h < 3)
+				{
+					valid = false;
+					break;
+				}
+				resolutions.push_back(std::make_pair(w, h));
+			}
+			valid = valid && !resolutions.empty();
+		}
+		else
+			valid = false;
+
+		std::string rest;
+		if (!valid || (words.clear(), words >> rest))
+		{
+			error = "line " + std::to_string(line) + ": invalid " + name;
+			return false;
+		}
+	}
+
+	// the parameters that aren't swept keep the value of the scene
+	const ClothDesc &desc = scene.cloths[0];
+	if (iterations.empty()) iterations.push_back(desc.iterations);
+	if (stretches.empty()) stretches.push_back(desc.stretchFactor);
+	if (dampings.empty()) dampings.push_back(desc.damping);
+	if (resolutions.empty()) resolutions.push_back(std::make_pair(desc.particlesWidth, desc.particlesHeight));
+	return true;
+}
+
+// runs every combination in parallel and writes one line per run to a csv file
+bool Sweep::Execute(ThreadPool &pool, const char* csvFileName)
+{
+	// every combination of the parameters is a run, seeded from the scene and its place in the sweep
+	std::vector<Run> runs;
+	for (size_t r = 0; r < resolutions.size(); r++)
+		for (size_t i = 0; i < iterations.size(); i++)
+			for (size_t s = 0; s < stretches.size(); s++)
+				for (size_t d = 0; d < dampings.size(); d++)
+				{
+					Run run = { iterations[i], stretches[s], dampings[d], resolutions[r].first, resolutions[r].second,
+						Random::Hash(scene.cloths[0].seed, runs.size()), 0.0f, 0.0f, 0, 0.0 };
+					runs.push_back(run);
+				}
+
+	std::cout << "running " << runs.size() << " combinations of " << steps << " steps on " << pool.GetThreadCount() + 1 << " threads" << std::endl;
+	pool.ParallelFor((int)runs.size(), [this, &runs](int i) { Simulate(runs[i]); });
+
+	// the runs are written in order, whichever thread finished first
+	FILE *file = fopen(csvFileName, "w");
+	if (!file)
+		return false;
+	fprintf(file, "run,iterations,stretch,damping,width,height,steps,energy,max_stretch,tears,ms_per_step\n");
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		Run &run = runs[i];
+		fprintf(file, "%d,%d,%g,%g,%d,%d,%d,%g,%g,%d,%.4f\n", (int)i, run.iterations, run.stretch, run.damping, run.width, run.height,
+			steps, run.energy, run.maxStretch, run.tears, run.msPerStep);
+	}
+	bool written = !ferror(file);
+	return (fclose(file) == 0) && written;
+}
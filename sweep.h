@@ -0,0 +1,43 @@
+/* runs the first cloth of a scene headless for every combination of a grid of parameters, and writes the results to a csv file */
+class Sweep
+{
+private:
+	// the parameters and results of a single run
+	struct Run
+	{
+		int iterations;            // the amount of constraint iterations
+		float stretch, damping;    // the stretch factor and damping
+		int width, height;         // the resolution of the cloth
+		unsigned long long seed;   // the seed of the cloth, fixed per run so the results don't depend on the thread
+		float energy, maxStretch;  // the kinetic energy and largest constraint stretch after the last step
+		int tears;                 // the amount of torn constraints
+		double msPerStep;          // the average time of a step
+	};
+
+	Scene scene; // the scene the cloth, the spheres and the forces come from
+	int steps;   // the amount of steps of every run
+
+	// the values of every parameter, the combinations of all of them are run
+	std::vector<int> iterations;
+	std::vector<float> stretches, dampings;
+	std::vector<std::pair<int, int> > resolutions;
+
+	// the reason the last load failed
+	std::string error;
+
+	// simulates a single run and fills in its results
+	void Simulate(Run &run);
+
+public:
+	// constructor, an empty sweep runs the default scene once
+	Sweep() : steps(500) {}
+
+	// loads a sweep file, returns false if the file can't be read or isn't valid
+	bool Load(const char* fileName);
+
+	// returns the reason the last load failed
+	const std::string& GetError() { return error; }
+
+	// runs every combination in parallel and writes one line per run to a csv file, returns false if the file couldn't be written
+	bool Execute(ThreadPool &pool, const char* csvFileName);
+};
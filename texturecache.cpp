@@ -0,0 +1,84 @@
+#include "precomp.h" // only include this header in source files
+
+// forward declarations
+bool LoadPNGFile(const char* fileName, unsigned int& w, unsigned int& h, std::vector<unsigned char>& image);
+GLuint CreateTexture(unsigned int* pixels, int w, int h);
+
+/* Private methods */
+
+// decodes an image file
+void TextureCache::Decode(const std::string fileName, Entry *entry)
+{
+	// the loader can't read an empty or missing file
+	bool loaded = std::ifstream(fileName.c_str()).good() && LoadPNGFile(fileName.c_str(), entry->width, entry->height, entry->pixels);
+	entry->failed = !loaded || entry->pixels.empty();
+	if (entry->failed)
+		std::cout << "could not load texture " << fileName << std::endl;
+	entry->decoded = true;
+	decoding--;
+}
+
+/* Public methods */
+
+// destructor, waits for the images that are still being decoded and frees the textures
+TextureCache::~TextureCache()
+{
+	pool.Wait(decoding);
+
+	std::map<std::string, Entry*>::iterator entry;
+	for (entry = entries.begin(); entry != entries.end(); entry++)
+	{
+		if ((*entry).second->texture)
+			glDeleteTextures(1, &(*entry).second->texture);
+		delete (*entry).second;
+	}
+}
+
+// starts decoding an image file if it wasn't requested before
+void TextureCache::Request(const std::string &fileName)
+{
+	Entry *entry;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (entries.count(fileName))
+			return;
+		entry = new Entry();
+		entry->width = entry->height = 0;
+		entry->decoded = false;
+		entry->failed = false;
+		entry->texture = 0;
+		entries[fileName] = entry;
+	}
+
+	// without workers the image is decoded right away
+	decoding++;
+	pool.Submit([this, fileName, entry] { Decode(fileName, entry); });
+}
+
+// returns the texture of an image file, uploading it the first time it is ready
+GLuint TextureCache::GetTexture(const std::string &fileName)
+{
+	Entry *entry;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		std::map<std::string, Entry*>::iterator found = entries.find(fileName);
+		if (found == entries.end())
+			return 0;
+		entry = (*found).second;
+	}
+	if (!entry->decoded || entry->failed)
+		return 0;
+
+	// the decoded pixels are only needed until the texture is on the gpu
+	if (!entry->texture)
+	{
+		entry->texture = CreateTexture((unsigned int*)&entry->pixels[0], entry->width, entry->height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		std::vector<unsigned char>().swap(entry->pixels);
+	}
+	return entry->texture;
+}
@@ -0,0 +1,36 @@
+/* decodes every image file only once per process, on a worker thread, and keeps its texture */
+class TextureCache
+{
+private:
+	// an image file, decoded on a worker and uploaded to the gpu on the thread that draws
+	struct Entry
+	{
+		std::vector<unsigned char> pixels; // the decoded image, 4 bytes per pixel, freed once it is uploaded
+		unsigned int width, height;        // the size of the image
+		std::atomic<bool> decoded;         // is the decoding finished or not
+		bool failed;                       // could the file not be decoded
+		GLuint texture;                    // the texture, zero until it is uploaded
+	};
+
+	ThreadPool &pool;                     // decodes the images
+	std::map<std::string, Entry*> entries; // the requested images by file name
+	std::mutex lock;
+	std::atomic<int> decoding;            // the amount of images that are still being decoded
+
+	// decodes an image file
+	void Decode(const std::string fileName, Entry *entry);
+
+public:
+	// constructor, decodes the images on a thread pool
+	TextureCache(ThreadPool &pool) : pool(pool), decoding(0) {}
+
+	// destructor, waits for the images that are still being decoded and frees the textures
+	~TextureCache();
+
+	// starts decoding an image file if it wasn't requested before
+	void Request(const std::string &fileName);
+
+	// returns the texture of an image file, uploading it the first time it is ready
+	// returns zero while the image is still being decoded or if it couldn't be decoded, must be called on the thread that draws
+	GLuint GetTexture(const std::string &fileName);
+};
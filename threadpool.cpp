@@ -0,0 +1,205 @@
+#include "precomp.h" // only include this header in source files
+
+thread_local ThreadPool *ThreadPool::currentPool = NULL;
+thread_local int ThreadPool::currentQueue = -1;
+
+/* Private methods */
+
+// runs a single task from the own queue or stolen from another queue, returns false if there was nothing to run
+bool ThreadPool::RunOne()
+{
+	int own = (currentPool == this) ? currentQueue : -1;
+	int count = (int)queues.size();
+	std::function<void()> task;
+
+	// the newest task of the own queue is the most likely to still be in the cache
+	if (own >= 0)
+	{
+		std::lock_guard<std::mutex> guard(queues[own]->lock);
+		if (!queues[own]->tasks.empty())
+		{
+			task = std::move(queues[own]->tasks.back());
+			queues[own]->tasks.pop_back();
+		}
+	}
+
+	// steal the oldest task of another queue, starting from the next queue to spread the stealing
+	for (int i = 1; i <= count && !task; i++)
+	{
+		int victim = (own + i + count) % count;
+		if (victim == own)
+			continue;
+		std::lock_guard<std::mutex> guard(queues[victim]->lock);
+		if (!queues[victim]->tasks.empty())
+		{
+			task = std::move(queues[victim]->tasks.front());
+			queues[victim]->tasks.pop_front();
+		}
+	}
+
+	if (!task)
+		return false;
+	queued--;
+	task();
+	return true;
+}
+
+// runs tasks until the pool is stopped
+void ThreadPool::WorkerLoop(int index)
+{
+	currentPool = this;
+	currentQueue = index;
+	while (true)
+	{
+		if (RunOne())
+			continue;
+
+		// sleep until there are tasks again
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [this] { return stopping || queued > 0; });
+		if (stopping)
+			return;
+	}
+}
+
+/* Public methods */
+
+// constructor, starts a certain amount of workers, by default one less than the amount of cores
+ThreadPool::ThreadPool(int threadCount)
+	: queued(0), next(0), stopping(false)
+{
+	if (threadCount < 0)
+		threadCount = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+
+	for (int i = 0; i < threadCount; i++)
+		queues.push_back(new Queue());
+	for (int i = 0; i < threadCount; i++)
+		threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+}
+
+// destructor, stops the workers
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	for (size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+// queues a task, on the queue of the current worker or spread over the queues if it isn't a worker
+void ThreadPool::Submit(std::function<void()> task)
+{
+	if (queues.empty())
+	{
+		task();
+		return;
+	}
+
+	int index = (currentPool == this) ? currentQueue : (int)(next++ % queues.size());
+	{
+		std::lock_guard<std::mutex> guard(queues[index]->lock);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+	queued++;
+
+	// wake up a sleeping worker, taking the lock makes sure a worker that is about to sleep sees the task
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wake.notify_one();
+}
+
+// runs tasks until a counter of unfinished tasks reaches zero
+void ThreadPool::Wait(std::atomic<int> &remaining)
+{
+	// help running the tasks instead of waiting, a worker calling this keeps its queue going
+	while (remaining > 0)
+		if (!RunOne())
+			std::this_thread::yield();
+}
+
+// calls body(i) for every i from 0 to count in parallel, and returns once all of them are done
+void ThreadPool::ParallelFor(int count, const std::function<void(int)> &body, int grain)
+{
+	if (grain <= 0)
+		grain = std::max(count / (4 * ((int)threads.size() + 1)), 1);
+
+	// without workers, or with a single task, there is nothing to run in parallel
+	if (threads.empty() || count <= grain)
+	{
+		for (int i = 0; i < count; i++)
+			body(i);
+		return;
+	}
+
+	std::atomic<int> remaining((count + grain - 1) / grain);
+	for (int begin = 0; begin < count; begin += grain)
+	{
+		int end = std::min(begin + grain, count);
+		Submit([&body, &remaining, begin, end]
+		{
+			for (int i = begin; i < end; i++)
+				body(i);
+			remaining--;
+		});
+	}
+	Wait(remaining);
+}
+
+/* TaskGraph private methods */
+
+// submits a task whose dependencies are done, and starts its dependents once it is done itself
+void TaskGraph::Start(ThreadPool &pool, int task, std::atomic<int> &remaining)
+{
+	pool.Submit([this, &pool, task, &remaining]
+	{
+		Node &node = nodes[task];
+		node.work();
+
+		// the last dependency to finish starts a dependent
+		for (size_t i = 0; i < node.dependents.size(); i++)
+			if (--nodes[node.dependents[i]].waiting == 0)
+				Start(pool, node.dependents[i], remaining);
+		remaining--;
+	});
+}
+
+/* TaskGraph public methods */
+
+// adds a task that waits for other tasks, which have to be added before it so the graph can't have cycles
+int TaskGraph::Add(std::function<void()> work, const std::vector<int> &dependencies)
+{
+	int index = (int)nodes.size();
+	nodes.emplace_back();
+	Node &node = nodes.back();
+	node.work = std::move(work);
+	node.dependencies = 0;
+
+	// dependencies on tasks that don't exist yet are ignored
+	for (size_t i = 0; i < dependencies.size(); i++)
+		if (dependencies[i] >= 0 && dependencies[i] < index)
+		{
+			nodes[dependencies[i]].dependents.push_back(index);
+			node.dependencies++;
+		}
+	return index;
+}
+
+// runs all the tasks and returns once they are done, the graph can be run again afterwards
+void TaskGraph::Run(ThreadPool &pool)
+{
+	std::atomic<int> remaining((int)nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+		nodes[i].waiting = nodes[i].dependencies;
+
+	// start the tasks that don't wait for anything
+	for (size_t i = 0; i < nodes.size(); i++)
+		if (nodes[i].dependencies == 0)
+			Start(pool, (int)i, remaining);
+	pool.Wait(remaining);
+}
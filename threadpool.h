@@ -0,0 +1,82 @@
+/* persistent pool of worker threads, every worker has its own queue of tasks and steals from the others when it runs out */
+class ThreadPool
+{
+private:
+	// the tasks of a worker, the worker takes them from the back and the others steal from the front
+	struct Queue
+	{
+		std::deque<std::function<void()> > tasks;
+		std::mutex lock;
+	};
+
+	std::vector<Queue*> queues;      // one queue per worker
+	std::vector<std::thread> threads; // the workers
+
+	// sleeping workers wait until tasks are queued
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<int> queued;         // the amount of tasks in all the queues
+	std::atomic<unsigned int> next;  // the queue that gets the next task submitted from outside the pool
+	bool stopping;
+
+	// the pool and queue of the current thread, so tasks submitted by a worker go to its own queue
+	static thread_local ThreadPool *currentPool;
+	static thread_local int currentQueue;
+
+	// runs a single task from the own queue or stolen from another queue, returns false if there was nothing to run
+	bool RunOne();
+
+	// runs tasks until the pool is stopped
+	void WorkerLoop(int index);
+
+public:
+	// constructor, starts a certain amount of workers, by default one less than the amount of cores
+	// the thread that waits for the tasks helps running them, so all the cores are used
+	ThreadPool(int threadCount = -1);
+
+	// destructor, stops the workers
+	~ThreadPool();
+
+	// returns the amount of workers
+	int GetThreadCount() { return (int)threads.size(); }
+
+	// queues a task, on the queue of the current worker or spread over the queues if it isn't a worker
+	// without workers the task is run right away
+	void Submit(std::function<void()> task);
+
+	// runs tasks until a counter of unfinished tasks reaches zero
+	void Wait(std::atomic<int> &remaining);
+
+	// calls body(i) for every i from 0 to count in parallel, and returns once all of them are done
+	// every task handles grain consecutive calls, a grain of zero picks one that gives every thread a few tasks
+	// the calls can run in any order, so they should be independent of each other
+	void ParallelFor(int count, const std::function<void(int)> &body, int grain = 1);
+};
+
+/* a set of tasks with dependencies, every task is run on a thread pool as soon as the tasks it depends on are done */
+class TaskGraph
+{
+private:
+	struct Node
+	{
+		std::function<void()> work;  // the work of the task
+		std::vector<int> dependents; // the tasks that wait for this task
+		int dependencies;            // the amount of tasks this task waits for
+		std::atomic<int> waiting;    // the amount of tasks this task still waits for during a run
+	};
+	std::deque<Node> nodes;
+
+	// submits a task whose dependencies are done, and starts its dependents once it is done itself
+	void Start(ThreadPool &pool, int task, std::atomic<int> &remaining);
+
+public:
+	// adds a task that waits for other tasks, which have to be added before it so the graph can't have cycles
+	// returns the index of the task, to use as a dependency of later tasks
+	int Add(std::function<void()> work, const std::vector<int> &dependencies = std::vector<int>());
+
+	// removes all the tasks
+	void Clear() { nodes.clear(); }
+
+	// runs all the tasks and returns once they are done, the graph can be run again afterwards
+	void Run(ThreadPool &pool);
+};
@@ -1,24 +1,31 @@
-/* minimal 3 dimensional vector class */
-class Vec3
+/* minimal 3 dimensional vector class, templated on the scalar type so the math can run in float or double */
+template<typename T>
+class Vector3
 {
 public:
-	float f[3]; // float container 
+	typedef T Scalar; // the type of the components
+
+	T f[3]; // component container 
 
 	// constructors
-	Vec3() {}
-	Vec3(float x, float y, float z) { f[0] = x; f[1] = y; f[2] = z; }
+	Vector3() {}
+	Vector3(T x, T y, T z) { f[0] = x; f[1] = y; f[2] = z; }
+
+	// converts a vector of another precision
+	template<typename U>
+	explicit Vector3(const Vector3<U> &v) { f[0] = (T)v.f[0]; f[1] = (T)v.f[1]; f[2] = (T)v.f[2]; }
 
 	// basic arithmetic operators
-	Vec3 operator+ (const Vec3 &v) { return Vec3(f[0] + v.f[0], f[1] + v.f[1], f[2] + v.f[2]); }
-	Vec3 operator- (const Vec3 &v) { return Vec3(f[0] - v.f[0], f[1] - v.f[1], f[2] - v.f[2]); }
-	Vec3 operator/ (const float &a) { return Vec3(f[0] / a, f[1] / a, f[2] / a); }
-	Vec3 operator* (const float &a){ return Vec3(f[0] * a, f[1] * a, f[2] * a); }
+	Vector3 operator+ (const Vector3 &v) const { return Vector3(f[0] + v.f[0], f[1] + v.f[1], f[2] + v.f[2]); }
+	Vector3 operator- (const Vector3 &v) const { return Vector3(f[0] - v.f[0], f[1] - v.f[1], f[2] - v.f[2]); }
+	Vector3 operator/ (const T &a) const { return Vector3(f[0] / a, f[1] / a, f[2] / a); }
+	Vector3 operator* (const T &a) const { return Vector3(f[0] * a, f[1] * a, f[2] * a); }
 
 	// returns the negative of the vector
-	Vec3 operator- () { return Vec3(-f[0], -f[1], -f[2]); }
+	Vector3 operator- () const { return Vector3(-f[0], -f[1], -f[2]); }
 
 	// concatenated addition
-	void operator+= (const Vec3 &v)
+	void operator+= (const Vector3 &v)
 	{
 		f[0] += v.f[0];
 		f[1] += v.f[1];
@@ -26,7 +33,7 @@ public:
 	}
 
 	// concatenated subtraction
-	void operator-= (const Vec3 &v)
+	void operator-= (const Vector3 &v)
 	{
 		f[0] -= v.f[0];
 		f[1] -= v.f[1];
@@ -34,24 +41,28 @@ public:
 	}
 
 	// returns the length of the vector
-	float Length() { return sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]); }
+	T Length() const { return sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]); }
 
 	// normalizes the vector
-	Vec3 Normalized()
+	Vector3 Normalized() const
 	{
-		float l = Length();
-		return Vec3(f[0] / l, f[1] / l, f[2] / l);
+		T l = Length();
+		return Vector3(f[0] / l, f[1] / l, f[2] / l);
 	}
 
 	// returns the dot product of two vectors
-	float Dot(const Vec3 &v)
+	T Dot(const Vector3 &v) const
 	{
 		return f[0] * v.f[0] + f[1] * v.f[1] + f[2] * v.f[2];
 	}
 
 	// returns the cross product of two vectors
-	Vec3 Cross(const Vec3 &v)
+	Vector3 Cross(const Vector3 &v) const
 	{
-		return Vec3(f[1] * v.f[2] - f[2] * v.f[1], f[2] * v.f[0] - f[0] * v.f[2], f[0] * v.f[1] - f[1] * v.f[0]);
+		return Vector3(f[1] * v.f[2] - f[2] * v.f[1], f[2] * v.f[0] - f[0] * v.f[2], f[0] * v.f[1] - f[1] * v.f[0]);
 	}
-};
\ No newline at end of file
+};
+
+// the simulation and drawing use float vectors, offline runs can use double vectors
+typedef Vector3<float> Vec3;
+typedef Vector3<double> Vec3d;
\ No newline at end of file
@@ -0,0 +1,87 @@
+/* 3 dimensional float vector padded to 4 floats and aligned to 16 bytes, so every operation is a single sse2 instruction */
+// the fourth float is always zero, so it doesn't change the dot product, the length or the cross product
+class alignas(16) Vec3a
+{
+public:
+	typedef float Scalar; // the type of the components
+
+	float f[4]; // float container, the last float is padding
+
+	// constructors
+	Vec3a() {}
+	Vec3a(float x, float y, float z) { f[0] = x; f[1] = y; f[2] = z; f[3] = 0.0f; }
+
+	// converts a vector of another precision
+	template<typename U>
+	explicit Vec3a(const Vector3<U> &v) { f[0] = (float)v.f[0]; f[1] = (float)v.f[1]; f[2] = (float)v.f[2]; f[3] = 0.0f; }
+
+#ifdef USE_SSE2
+	// basic arithmetic operators
+	Vec3a operator+ (const Vec3a &v) const { return Vec3a(_mm_add_ps(Load(), v.Load())); }
+	Vec3a operator- (const Vec3a &v) const { return Vec3a(_mm_sub_ps(Load(), v.Load())); }
+	Vec3a operator/ (const float &a) const { return Vec3a(_mm_div_ps(Load(), _mm_set_ps(1.0f, a, a, a))); }
+	Vec3a operator* (const float &a) const { return Vec3a(_mm_mul_ps(Load(), _mm_set1_ps(a))); }
+
+	// returns the negative of the vector
+	Vec3a operator- () const { return Vec3a(_mm_sub_ps(_mm_setzero_ps(), Load())); }
+
+	// concatenated addition and subtraction
+	void operator+= (const Vec3a &v) { _mm_storeu_ps(f, _mm_add_ps(Load(), v.Load())); }
+	void operator-= (const Vec3a &v) { _mm_storeu_ps(f, _mm_sub_ps(Load(), v.Load())); }
+
+	// returns the dot product of two vectors, by adding the products of the 4 lanes in 2 steps
+	float Dot(const Vec3a &v) const
+	{
+		__m128 product = _mm_mul_ps(Load(), v.Load());
+		product = _mm_add_ps(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 0, 3, 2)));
+		product = _mm_add_ss(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(product);
+	}
+
+	// returns the cross product of two vectors, with the components rotated as y z x
+	Vec3a Cross(const Vec3a &v) const
+	{
+		__m128 a = Load(), b = v.Load();
+		__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+		return Vec3a(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+	}
+#else
+	// basic arithmetic operators
+	Vec3a operator+ (const Vec3a &v) const { return Vec3a(f[0] + v.f[0], f[1] + v.f[1], f[2] + v.f[2]); }
+	Vec3a operator- (const Vec3a &v) const { return Vec3a(f[0] - v.f[0], f[1] - v.f[1], f[2] - v.f[2]); }
+	Vec3a operator/ (const float &a) const { return Vec3a(f[0] / a, f[1] / a, f[2] / a); }
+	Vec3a operator* (const float &a) const { return Vec3a(f[0] * a, f[1] * a, f[2] * a); }
+
+	// returns the negative of the vector
+	Vec3a operator- () const { return Vec3a(-f[0], -f[1], -f[2]); }
+
+	// concatenated addition and subtraction
+	void operator+= (const Vec3a &v) { f[0] += v.f[0]; f[1] += v.f[1]; f[2] += v.f[2]; }
+	void operator-= (const Vec3a &v) { f[0] -= v.f[0]; f[1] -= v.f[1]; f[2] -= v.f[2]; }
+
+	// returns the dot product of two vectors
+	float Dot(const Vec3a &v) const { return f[0] * v.f[0] + f[1] * v.f[1] + f[2] * v.f[2]; }
+
+	// returns the cross product of two vectors
+	Vec3a Cross(const Vec3a &v) const
+	{
+		return Vec3a(f[1] * v.f[2] - f[2] * v.f[1], f[2] * v.f[0] - f[0] * v.f[2], f[0] * v.f[1] - f[1] * v.f[0]);
+	}
+#endif
+
+	// returns the length of the vector
+	float Length() const { return sqrtf(Dot(*this)); }
+
+	// normalizes the vector
+	Vec3a Normalized() const { return *this / Length(); }
+
+private:
+#ifdef USE_SSE2
+	// converts from and to the 4 floats of an sse2 register, without relying on the alignment
+	// so the vectors can also live in containers and allocations that don't honor it
+	explicit Vec3a(__m128 v) { _mm_storeu_ps(f, v); }
+	__m128 Load() const { return _mm_loadu_ps(f); }
+#endif
+};
@@ -0,0 +1,158 @@
+#include "precomp.h" // only include this header in source files
+
+/* Private methods */
+
+// moves the spheres, the spheres are drawn with the y and z axes swapped
+template<typename V>
+void BasicWorld<V>::MoveSpheres()
+{
+	if (moveSpheres)
+	{
+		time++;
+		for (size_t i = 0; i < spheres.size(); i++)
+			if (scene.spheres[i].amplitude != 0.0f)
+				spheres[i].UpdatePosition(-Scene::GetSpherePosition(scene.spheres[i], time).f[2]);
+	}
+
+	for (size_t i = 0; i < spheres.size(); i++)
+	{
+		Vec3 pos = spheres[i].GetPosition();
+		centers[i] = Vec3(pos.f[0], pos.f[2], -pos.f[1]);
+	}
+}
+
+// adds the forces to a cloth and updates it
+template<typename V>
+void BasicWorld<V>::UpdateCloth(int c)
+{
+	// without wind the cloth still moves through still air, so the drag is always applied
+	cloths[c]->AddForce(gravity);
+	cloths[c]->AddWindForce(windForce);
+	cloths[c]->Update();
+}
+
+// resolves the collisions of a cloth with the spheres
+template<typename V>
+void BasicWorld<V>::CollideCloth(int c)
+{
+	for (size_t i = 0; i < centers.size(); i++)
+		cloths[c]->SphereCollision(centers[i], scene.spheres[i].radius);
+}
+
+// moves the particles of a cloth that collided, once its normals and collisions are done
+template<typename V>
+void BasicWorld<V>::FinishCloth(int c)
+{
+	cloths[c]->ApplyCollisions();
+}
+
+/* Public methods */
+
+// constructor, creates the cloths and spheres of a scene
+template<typename V>
+BasicWorld<V>::BasicWorld(const Scene &scene, ThreadPool &pool)
+	: scene(scene), time(0.0f), pool(pool), moveSpheres(false)
+{
+	for (size_t i = 0; i < scene.cloths.size(); i++)
+		cloths.push_back(Scene::CreateCloth<V>(scene.cloths[i]));
+	for (size_t i = 0; i < scene.spheres.size(); i++)
+		spheres.push_back(Scene::CreateSphere(scene.spheres[i]));
+	centers.resize(spheres.size());
+
+	// build the graph of a step, the collisions of a cloth wait for its update and for the spheres,
+	// the normals only read the positions so they are computed at the same time as the collisions
+	int move = stepGraph.Add([this] { MoveSpheres(); });
+	for (int c = 0; c < (int)cloths.size(); c++)
+	{
+		int update = stepGraph.Add([this, c] { UpdateCloth(c); });
+		std::vector<int> dependencies;
+		dependencies.push_back(move);
+		dependencies.push_back(update);
+		int collide = stepGraph.Add([this, c] { CollideCloth(c); }, dependencies);
+		int normals = stepGraph.Add([this, c] { cloths[c]->UpdateNormals(); }, std::vector<int>(1, update));
+		dependencies.assign(1, collide);
+		dependencies.push_back(normals);
+		stepGraph.Add([this, c] { FinishCloth(c); }, dependencies);
+	}
+}
+
+// destructor
+template<typename V>
+BasicWorld<V>::~BasicWorld()
+{
+	for (size_t i = 0; i < cloths.size(); i++)
+		delete cloths[i];
+}
+
+// moves the spheres and updates every cloth, with or without wind, the spheres can be kept still
+template<typename V>
+void BasicWorld<V>::Step(bool wind, bool moving)
+{
+	gravity = scene.gravity * TIMESTEP2;
+	windForce = wind ? scene.wind * TIMESTEP2 : Vec3(0, 0, 0);
+	moveSpheres = moving;
+	stepGraph.Run(pool);
+}
+
+// resets every cloth, and pins it as given by the scene
+template<typename V>
+void BasicWorld<V>::Reset()
+{
+	for (size_t i = 0; i < cloths.size(); i++)
+	{
+		cloths[i]->ResetCloth();
+		Scene::ApplyPins(*cloths[i], scene.cloths[i]);
+	}
+}
+
+// calls a method on every cloth, for example &Cloth::SwitchTearable
+template<typename V>
+void BasicWorld<V>::ForEachCloth(void (BasicCloth<V>::*method)())
+{
+	for (size_t i = 0; i < cloths.size(); i++)
+		(cloths[i]->*method)();
+}
+
+// switches a corner of every cloth
+template<typename V>
+void BasicWorld<V>::SwitchCorner(int corner)
+{
+	for (size_t i = 0; i < cloths.size(); i++)
+		cloths[i]->SwitchCorner(corner);
+}
+
+// draws the spheres, all of them or only the spheres that don't move
+template<typename V>
+void BasicWorld<V>::DrawSpheres(bool moving)
+{
+	for (size_t i = 0; i < spheres.size(); i++)
+		if (moving || scene.spheres[i].amplitude == 0.0f)
+			spheres[i].Draw();
+}
+
+// starts decoding the textures of the cloths
+template<typename V>
+void BasicWorld<V>::RequestTextures(TextureCache &textures)
+{
+	for (size_t i = 0; i < cloths.size(); i++)
+		if (!scene.cloths[i].texture.empty())
+			textures.Request(scene.cloths[i].texture);
+}
+
+// draws the cloths, their draw arrays are built in parallel
+template<typename V>
+void BasicWorld<V>::DrawCloths(TextureCache &textures)
+{
+	for (size_t i = 0; i < cloths.size(); i++)
+		if (!scene.cloths[i].texture.empty() && !cloths[i]->HasTexture())
+			cloths[i]->SetTexture(textures.GetTexture(scene.cloths[i].texture));
+
+	pool.ParallelFor((int)cloths.size(), [this](int c) { cloths[c]->BuildDrawArrays(); });
+	for (size_t i = 0; i < cloths.size(); i++)
+		cloths[i]->DrawArrays();
+}
+
+// the world in float, in double for offline runs, and in float vectors padded for sse2
+template class BasicWorld<Vec3>;
+template class BasicWorld<Vec3d>;
+template class BasicWorld<Vec3a>;
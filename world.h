@@ -0,0 +1,63 @@
+/* owns the cloths and spheres of a scene, and steps the independent cloths in parallel */
+// the cloths are simulated in the precision of the vector type, the spheres and forces are always given in float
+template<typename V>
+class BasicWorld
+{
+private:
+	Scene scene;                          // the description of the world
+	std::vector<BasicCloth<V>*> cloths;   // the cloths, in the order of the scene
+	std::vector<Sphere> spheres; // the drawable spheres, in the order of the scene
+	float time;                  // the amount of timesteps the spheres have moved
+	ThreadPool &pool;            // runs the cloths in parallel
+
+	// a step as a graph of tasks, moving the spheres overlaps with updating the cloths, every cloth resolves its
+	// collisions once it is updated and the spheres have moved, while its normals are computed on another thread
+	TaskGraph stepGraph;
+	std::vector<Vec3> centers;   // the sphere centers in world, with the axes the cloths use
+	Vec3 gravity, windForce;     // the forces of the current step, per timestep squared
+	bool moveSpheres;            // do the spheres move during the current step or not
+
+	// the tasks of a step
+	void MoveSpheres();
+	void UpdateCloth(int c);
+	void CollideCloth(int c);
+	void FinishCloth(int c);
+
+public:
+	// constructor, creates the cloths and spheres of a scene
+	BasicWorld(const Scene &scene, ThreadPool &pool);
+
+	// destructor
+	~BasicWorld();
+
+	// returns the scene, the amount of cloths and a cloth
+	const Scene& GetScene() { return scene; }
+	int GetClothCount() { return (int)cloths.size(); }
+	BasicCloth<V>& GetCloth(int i) { return *cloths[i]; }
+
+	// moves the spheres and updates every cloth, with or without wind, the spheres can be kept still
+	// every cloth only depends on itself and the spheres, so the result doesn't depend on the amount of threads
+	void Step(bool wind, bool moving);
+
+	// resets every cloth, and pins it as given by the scene
+	void Reset();
+
+	// calls a method on every cloth, for example &Cloth::SwitchTearable
+	void ForEachCloth(void (BasicCloth<V>::*method)());
+
+	// switches a corner of every cloth
+	void SwitchCorner(int corner);
+
+	// draws the spheres, all of them or only the spheres that don't move
+	void DrawSpheres(bool moving);
+
+	// starts decoding the textures of the cloths
+	void RequestTextures(TextureCache &textures);
+
+	// draws the cloths, their draw arrays are built in parallel
+	// the cloths are drawn with their pattern until their texture is decoded
+	void DrawCloths(TextureCache &textures);
+};
+
+// the interactive world is simulated in float
+typedef BasicWorld<Vec3> World;